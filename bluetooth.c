@@ -3,167 +3,48 @@
  * @brief		Bluetooth library for KL46Z and HC-06 module
  */
  
-#include "MKL46Z4.h"
+#include "zumo_hal.h"
 #include "bluetooth.h"
 #include <string.h>
 
 // Global variables
-volatile UART_BUF_t RxBuf;
-volatile UART_BUF_t	TxBuf;
-volatile int16_t string_count = 0;
+HAL_STATE volatile UART_BUF_t RxBuf;
+HAL_STATE volatile UART_BUF_t	TxBuf;
+HAL_STATE volatile int16_t string_count = 0;
 
-/**
-	@brief Interrupt handler
-	@details	It reacts to byte coming or empty D buffer (in UART module).
-						Incoming CR character is converted to NULL 
-						(for comfortable usage of terminal e.g. Putty)
-*/
-#if (UART_MODULE == 0)
-void UART0_IRQHandler(void){
-	
-#elif (UART_MODULE == 1)
-void UART1_IRQHandler(void){
-	
-#elif (UART_MODULE == 2)
-void UART2_IRQHandler(void){
-#endif	
-	
-	__disable_irq();
+void bt_init( uint32_t baud_rate ){
+
+	buf_clear(&TxBuf);
+	buf_clear(&RxBuf);
 	
-	if(UART(UART_MODULE)->S1 & UART_S1_RDRF_MASK){
-		
-		char c = UART(UART_MODULE)->D;
+	hal_uartInit( baud_rate );
+}
+
+
+void bt_receiveChar( char c ){
 
 #if OVERWRITE==1	
-		if( c == '\0' || c == '\r'){
-			string_count++;
-			c = '\0';
-		}
+	if( c == '\0' || c == '\r'){
+		string_count++;
+		c = '\0';
+	}
 #endif
+	
+	if( !buf_full(&RxBuf) ){
 		
-		if( !buf_full(&RxBuf) ){
-			
 #if OVERWRITE==0			
-			if( c == '\0' || c == '\r'){
-				string_count++;
-				c = '\0';
-			}
-#endif
-			
-			to_UART_buffer( c, &RxBuf );		
+		if( c == '\0' || c == '\r'){
+			string_count++;
+			c = '\0';
 		}
-		
-#if OVERWRITE==1
-		else	overwrite_UART_buffer( c, &RxBuf );
 #endif
-
-	}
-	
-	else if(UART(UART_MODULE)->S1 & UART_S1_TDRE_MASK){
 		
-		if( buf_empty(&TxBuf) ){
-			
-			// disable interrupt from transmitter
-			UART(UART_MODULE)->C2 &= ~UART_C2_TIE_MASK;
-			
-			TxBuf.tail = TxBuf.head; // force pointers equalization
-			// Sometimes, when transmitter is hardly loaded,
-			// tail pointer stops to far. "Size" indicator still works fine.
-		}
-		// If Tx buffer isn't empty put in UART next character.
-		else	UART(UART_MODULE)->D = from_UART_buffer( &TxBuf ); 
+		to_UART_buffer( c, &RxBuf );		
 	}
 	
-#if UART_MODULE==0
-	NVIC_ClearPendingIRQ(UART0_IRQn);
-#elif UART_MODULE==1
-	NVIC_ClearPendingIRQ(UART1_IRQn);
-#elif UART_MODULE==2
-	NVIC_ClearPendingIRQ(UART2_IRQn);
-#endif
-	
-	__enable_irq();
-}
-
-
-
-void bt_init( uint32_t baud_rate ){
-
-	uint32_t divisor;
-	
-	
-#if UART_MODULE==0
-	SIM->SCGC5 |= SIM_SCGC5_PORTA_MASK; 	// PTA14(TX) PTA15(RX) on mux(3) will be used.
-	SIM->SOPT2 |= SIM_SOPT2_UART0SRC(1);
-	SIM->SOPT2 |= SIM_SOPT2_PLLFLLSEL_MASK;
-	SIM->SCGC4 |= SIM_SCGC4_UART0_MASK;
-	PORTA->PCR[14] |= PORT_PCR_MUX(3);
-	PORTA->PCR[15] |= PORT_PCR_MUX(3);
-	
-#elif UART_MODULE==1
-	SIM->SCGC4 |= SIM_SCGC4_UART1_MASK;		// 24MHz bus clk
-	SIM->SCGC5 |= SIM_SCGC5_PORTE_MASK; 	// PTE0(TX) PTE1(RX) on mux(3) will be used.	
-	PORTE->PCR[0] |= PORT_PCR_MUX(3);
-	PORTE->PCR[1] |= PORT_PCR_MUX(3);
-	
-#elif UART_MODULE==2
-	SIM->SCGC4 |= SIM_SCGC4_UART2_MASK;		// 24MHz bus clk
-	SIM->SCGC5 |= SIM_SCGC5_PORTE_MASK; 	// PTE16(TX) PTE17(RX) on mux(3) will be used.	
-	PORTE->PCR[16] |= PORT_PCR_MUX(3);
-	PORTE->PCR[17] |= PORT_PCR_MUX(3);
-#endif
-
-	// UART module disable
-	UART(UART_MODULE)->C2 &= ~(UART_C2_TE_MASK | UART_C2_RE_MASK);
-
-	// Setting prescaler value
-#if UART_MODULE==0
-	divisor = (48000000/baud_rate)/16;
-#else
-	divisor = (24000000/baud_rate)/16;
-#endif
-
-	// Cearing prescaler register
-	UART(UART_MODULE)->BDH &= ~UART_BDH_SBR_MASK;
-	UART(UART_MODULE)->BDL &= ~UART_BDL_SBR_MASK;	
-	
-	// Writting prescaler value to right register
-	UART(UART_MODULE)->BDH |= UART_BDH_SBR(divisor>>8);
-	UART(UART_MODULE)->BDL |= UART_BDL_SBR(divisor);
-	
-	// One stop bit
-	UART(UART_MODULE)->BDH &= ~UART_BDH_SBNS_MASK;
-	// No parity
-	UART(UART_MODULE)->C1 &= ~UART_C1_PE_MASK;
-	// 8-bit mode
-	UART(UART_MODULE)->C1 &= ~UART_C1_M_MASK;
-	
-	
-	// Interrupt settings
-#if UART_MODULE==0
-	NVIC_SetPriority(UART0_IRQn, UART_IRQ_PRIORITY);
-	NVIC_ClearPendingIRQ(UART0_IRQn);
-	NVIC_EnableIRQ(UART0_IRQn);
-	
-#elif UART_MODULE==1
-	NVIC_SetPriority(UART1_IRQn, UART_IRQ_PRIORITY);
-	NVIC_ClearPendingIRQ(UART1_IRQn);
-	NVIC_EnableIRQ(UART1_IRQn);
-	
-#elif UART_MODULE==2
-	NVIC_SetPriority(UART2_IRQn, UART_IRQ_PRIORITY);
-	NVIC_ClearPendingIRQ(UART2_IRQn);
-	NVIC_EnableIRQ(UART2_IRQn);
+#if OVERWRITE==1
+	else	overwrite_UART_buffer( c, &RxBuf );
 #endif
-
-	// Interrupts enable
-	UART(UART_MODULE)->C2 |= (UART_C2_TIE_MASK | UART_C2_RIE_MASK);
-	
-	buf_clear(&TxBuf);
-	buf_clear(&RxBuf);
-	
-	// UART module enable
-	UART(UART_MODULE)->C2 |= (UART_C2_TE_MASK | UART_C2_RE_MASK);
 }
 
 
@@ -182,10 +63,7 @@ uint8_t bt_sendChar( const char data ){
 	}
 #endif
 	
-	if( !(UART(UART_MODULE)->C2 & UART_C2_TIE_MASK) ){
-		UART(UART_MODULE)->D = from_UART_buffer( &TxBuf );
-		UART(UART_MODULE)->C2 |= UART_C2_TIE_MASK;
-	}
+	hal_uartKick();		// Start the transmission if transmitter is idle.
 	return exit;
 }
 
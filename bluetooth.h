@@ -5,7 +5,8 @@
  
 #ifndef BLUETOOTH_H_
 #define BLUETOOTH_H_
-#include "MKL46Z4.h"
+#include <stdint.h>
+#include "zumo_hal.h"
 
 // User settings
 /**
@@ -74,15 +75,15 @@ typedef struct{
 /**
 	@brief Circular buffer for received data
 */
-extern volatile UART_BUF_t RxBuf;
+extern HAL_STATE volatile UART_BUF_t RxBuf;
 /**
 	@brief Circular buffer for transmitting data
 */
-extern volatile UART_BUF_t TxBuf;
+extern HAL_STATE volatile UART_BUF_t TxBuf;
 /**
 	@brief Quantity of strings in Rx buffer
 */
-extern volatile int16_t string_count;
+extern HAL_STATE volatile int16_t string_count;
 
 
 // Main user functions
@@ -131,6 +132,13 @@ char bt_getChar( void );
 						Incoming string has to be ended with a (NULL) or (CR) character.
 */
 void bt_getStr( char * destination );
+/**
+	@brief Function puts received byte to Rx buffer. It is called from UART interrupt (HAL backend).
+	@details	Incoming CR character is converted to NULL 
+						(for comfortable usage of terminal e.g. Putty)
+	@param c Received byte
+*/
+void bt_receiveChar( char c );
 
 
 // Other functions
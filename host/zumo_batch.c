@@ -0,0 +1,285 @@
+/**
+	@file	zumo_batch.c
+	@brief	Runs Zumo maze solver on many simulated mazes in parallel (host build).
+	@details	Usage: zumo_batch [-j threads] [-p policies] [-s seed] [-t limit_s] [-o results.csv] [-l list.txt] [-c corpus.bin] [maze.txt ...]
+						<ul>
+							<li> -j - number of worker threads (default: one per core)
+							<li> -p - exploration policies separated by commas (see zumo_sim -p) or "all", every maze is run with each of them
+							<li> -s - seed of sensor noise (each maze gets seed + index)
+							<li> -t - virtual time limit of one run in seconds
+							<li> -o - CSV file with result of each run
+							<li> -l - file with maze paths, one per line
+							<li> -c - corpus made by zumo_mazegen, all its mazes are run after maze files
+						</ul>
+						Each run executes full sequence from main.c: calibration, exploration, optimization and replay.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "zumo_corpus.h"
+#include "zumo_pool.h"
+#include "zumo_sim.h"
+
+/**
+	@brief	Batch description shared by workers.
+*/
+typedef struct{
+	char ** path;								/**< Maze files */
+	uint32_t nbr_of_files;
+	corpus_t corpus;						/**< Mazes run after files */
+	const char * corpus_path;
+	uint32_t nbr_of_mazes;			/**< Files and corpus mazes */
+	mp_policy_t policy[ MP_NBR_OF_POLICIES ];		/**< Compared exploration policies */
+	uint32_t nbr_of_policies;
+	uint32_t seed;
+	uint64_t limit_us;
+	sim_maze_t ** maze;					/**< One maze buffer per worker */
+	sim_result_t * result;			/**< Result of each run (maze + policy * nbr_of_mazes) */
+	int8_t * status;						/**< 0 - finished, -1 - aborted (or map full), -2 - invalid maze */
+} batch_t;
+
+
+static void batch_task( void * ctx, unsigned worker, uint32_t task ){
+
+	batch_t * b = ctx;
+	sim_maze_t * maze = b->maze[worker];
+	uint32_t n = task % b->nbr_of_mazes;
+	int err;
+
+	if( n < b->nbr_of_files ) err = sim_loadMaze( maze, b->path[n] );
+	else{
+		const corpus_maze_t * m = corpus_get( &b->corpus, n - b->nbr_of_files );
+		err = (m == NULL) || corpus_render( m, maze );
+	}
+	if( err ){
+		memset( &b->result[task], 0, sizeof( sim_result_t ) );
+		b->status[task] = -2;
+		return;
+	}
+	// Fresh board (nothing saved in flash) and the same sensor noise for every policy
+	hal_host_setFlashFile( NULL );
+	b->status[task] = (int8_t)sim_run( maze, b->policy[ task / b->nbr_of_mazes ], b->seed + n, b->limit_us, NULL, &b->result[task] );
+}
+
+/**
+	@brief	Function appends paths from list file.
+*/
+static int batch_readList( const char * list, char *** path, uint32_t * n, uint32_t * capacity ){
+
+	FILE * f = fopen( list, "r" );
+	char line[ 4096 ];
+
+	if( f == NULL ) return -1;
+	while( fgets( line, sizeof( line ), f ) != NULL ){
+		size_t len = strcspn( line, "\r\n" );
+		line[len] = '\0';
+		if( len == 0 || line[0] == '#' ) continue;
+		if( *n == *capacity ){
+			*capacity = *capacity ? *capacity * 2 : 1024;
+			*path = realloc( *path, *capacity * sizeof( char * ) );
+		}
+		(*path)[ (*n)++ ] = strdup( line );
+	}
+	fclose( f );
+	return 0;
+}
+
+/**
+	@brief	Function reads list of policies separated by commas, or "all".
+*/
+static int batch_parsePolicies( const char * list, batch_t * b ){
+
+	char name[ 32 ];
+	size_t len;
+	int p;
+
+	b->nbr_of_policies = 0;
+	if( strcmp( list, "all" ) == 0 ){
+		for( p=0; p<MP_NBR_OF_POLICIES; p++ ) b->policy[ b->nbr_of_policies++ ] = p;
+		return 0;
+	}
+	while( *list ){
+		len = strcspn( list, "," );
+		if( len >= sizeof( name ) || b->nbr_of_policies >= MP_NBR_OF_POLICIES ) return -1;
+		memcpy( name, list, len );
+		name[len] = '\0';
+		p = sim_parsePolicy( name );
+		if( p < 0 ) return -1;
+		b->policy[ b->nbr_of_policies++ ] = p;
+		list += len;
+		if( *list == ',' ) list++;
+	}
+	return b->nbr_of_policies ? 0 : -1;
+}
+
+/**
+	@brief	Function prints statistics of runs with one policy.
+	@return	Return value is number of mazes finished in replay.
+*/
+static uint32_t batch_summary( batch_t * b, uint32_t p ){
+
+	uint32_t i;
+	double explore = 0, replay = 0;
+	uint32_t finished = 0, explored = 0, aborted = 0, full = 0, invalid = 0;
+	unsigned long nodes = 0;
+	double explore_frames = 0, replay_frames = 0;
+
+	// Scaling with maze size (corpus only), largest side grouped by 8 grid points
+	uint32_t band_mazes[ CORPUS_MAX_SIDE/8 + 1 ] = { 0 }, band_finished[ CORPUS_MAX_SIDE/8 + 1 ] = { 0 };
+	double band_explore[ CORPUS_MAX_SIDE/8 + 1 ] = { 0 };
+	unsigned long band_nodes[ CORPUS_MAX_SIDE/8 + 1 ] = { 0 }, band_route[ CORPUS_MAX_SIDE/8 + 1 ] = { 0 };
+
+	for( i=0; i<b->nbr_of_mazes; i++ ){
+		uint32_t task = p * b->nbr_of_mazes + i;
+		sim_result_t * r = &b->result[task];
+		if( b->status[task] == -2 ){ invalid++; continue; }
+		if( r->map_full ) full++;
+		else if( b->status[task] == -1 ) aborted++;
+		explored += r->explored;
+		if( r->finished ){
+			finished++;
+			explore += r->explore_us * 1e-6;
+			replay += r->replay_us * 1e-6;
+			nodes += r->explore_nodes;
+			explore_frames += r->explore_frames;
+			replay_frames += r->replay_frames;
+		}
+		if( i >= b->nbr_of_files ){
+			const corpus_maze_t * m = corpus_get( &b->corpus, i - b->nbr_of_files );
+			unsigned band = (m->width > m->height ? m->width : m->height) / 8;
+			band_mazes[band]++;
+			if( r->finished ){
+				band_finished[band]++;
+				band_explore[band] += r->explore_us * 1e-6;
+				band_nodes[band] += r->explore_nodes;
+				band_route[band] += r->replay_nodes;
+			}
+		}
+	}
+
+	if( b->nbr_of_policies > 1 ) printf( "\npolicy       %s\n", mp_policyName( b->policy[p] ) );
+	printf( "mazes        %u (invalid %u, aborted %u, map full %u)\n", b->nbr_of_mazes, invalid, aborted, full );
+	printf( "reached F    exploration %u, replay %u\n", explored, finished );
+	if( finished ){
+		printf( "mean         exploration %.3f s, replay %.3f s, %.1f nodes\n",
+						explore / finished, replay / finished, (double)nodes / finished );
+		printf( "frame rate   exploration %.0f Hz, replay %.0f Hz\n",
+						explore > 0 ? explore_frames / explore : 0, replay > 0 ? replay_frames / replay : 0 );
+	}
+
+	if( b->nbr_of_mazes > b->nbr_of_files ){
+		printf( "\nside     mazes  finished  exploration  explored nodes  route nodes\n" );
+		for( i=0; i<=CORPUS_MAX_SIDE/8; i++ ){
+			uint32_t n = band_finished[i] ? band_finished[i] : 1;
+			if( band_mazes[i] == 0 ) continue;
+			printf( "%2u-%-2u  %7u  %8u  %9.1f s  %14.1f  %11.1f\n", i ? i*8 : CORPUS_MIN_SIDE, i*8 + 7, band_mazes[i], band_finished[i],
+							band_explore[i] / n, (double)band_nodes[i] / n, (double)band_route[i] / n );
+		}
+	}
+	return finished;
+}
+
+int main( int argc, char * argv[] ){
+
+	batch_t b;
+	unsigned threads = 0;
+	uint32_t capacity = 0, i, p, runs, finished = 0;
+	const char * csv = NULL;
+	struct timespec t0, t1;
+	double wall, virtual_s = 0;
+	int a;
+
+	memset( &b, 0, sizeof( b ) );
+	b.seed = 1;
+	b.limit_us = 600ull * 1000000;
+	b.policy[0] = MP_TREMAUX;
+	b.nbr_of_policies = 1;
+
+	for( a=1; a<argc; a++ ){
+		if( strcmp( argv[a], "-j" ) == 0 && a+1 < argc ) threads = strtoul( argv[++a], NULL, 10 );
+		else if( strcmp( argv[a], "-s" ) == 0 && a+1 < argc ) b.seed = strtoul( argv[++a], NULL, 10 );
+		else if( strcmp( argv[a], "-t" ) == 0 && a+1 < argc ) b.limit_us = strtoull( argv[++a], NULL, 10 ) * 1000000;
+		else if( strcmp( argv[a], "-o" ) == 0 && a+1 < argc ) csv = argv[++a];
+		else if( strcmp( argv[a], "-c" ) == 0 && a+1 < argc ) b.corpus_path = argv[++a];
+		else if( strcmp( argv[a], "-p" ) == 0 && a+1 < argc ){
+			if( batch_parsePolicies( argv[++a], &b ) ){
+				fprintf( stderr, "%s: unknown policy\n", argv[a] );
+				return 2;
+			}
+		}
+		else if( strcmp( argv[a], "-l" ) == 0 && a+1 < argc ){
+			if( batch_readList( argv[++a], &b.path, &b.nbr_of_files, &capacity ) ){
+				fprintf( stderr, "%s: cannot read list\n", argv[a] );
+				return 2;
+			}
+		}
+		else{
+			if( b.nbr_of_files == capacity ){
+				capacity = capacity ? capacity * 2 : 1024;
+				b.path = realloc( b.path, capacity * sizeof( char * ) );
+			}
+			b.path[ b.nbr_of_files++ ] = strdup( argv[a] );
+		}
+	}
+	b.nbr_of_mazes = b.nbr_of_files;
+	if( b.corpus_path != NULL ){
+		if( corpus_open( &b.corpus, b.corpus_path ) ){
+			fprintf( stderr, "%s: invalid corpus\n", b.corpus_path );
+			return 2;
+		}
+		b.nbr_of_mazes += b.corpus.header->nbr_of_mazes;
+	}
+	if( b.nbr_of_mazes == 0 ){
+		fprintf( stderr, "usage: %s [-j threads] [-p policies] [-s seed] [-t limit_s] [-o results.csv] [-l list.txt] [-c corpus.bin] [maze.txt ...]\n", argv[0] );
+		return 2;
+	}
+	if( threads == 0 ) threads = pool_cores();
+	runs = b.nbr_of_mazes * b.nbr_of_policies;
+
+	b.result = calloc( runs, sizeof( sim_result_t ) );
+	b.status = calloc( runs, sizeof( int8_t ) );
+	b.maze = calloc( threads, sizeof( sim_maze_t * ) );
+	for( i=0; i<threads; i++ ) b.maze[i] = malloc( sizeof( sim_maze_t ) );
+
+	clock_gettime( CLOCK_MONOTONIC, &t0 );
+	if( pool_run( threads, runs, batch_task, &b ) ){
+		fprintf( stderr, "cannot start worker threads\n" );
+		return 2;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &t1 );
+	wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	if( csv != NULL ){
+		FILE * f = fopen( csv, "w" );
+		if( f == NULL ){
+			fprintf( stderr, "%s: cannot write results\n", csv );
+			return 2;
+		}
+		fprintf( f, "maze,width,height,status,explore_s,explore_nodes,replay_s,replay_nodes,finished,policy\n" );
+		for( i=0; i<runs; i++ ){
+			uint32_t n = i % b.nbr_of_mazes;
+			sim_result_t * r = &b.result[i];
+			const corpus_maze_t * m = NULL;
+			if( n < b.nbr_of_files ) fprintf( f, "%s,,,", b.path[n] );
+			else{
+				m = corpus_get( &b.corpus, n - b.nbr_of_files );
+				fprintf( f, "%s#%u,%u,%u,", b.corpus_path, n - b.nbr_of_files, m ? m->width : 0, m ? m->height : 0 );
+			}
+			fprintf( f, "%s,%.3f,%u,%.3f,%u,%u,%s\n",
+								b.status[i] == 0 ? "ok" : (b.status[i] == -2 ? "invalid" : (r->map_full ? "map full" : "aborted")),
+								r->explore_us * 1e-6, r->explore_nodes, r->replay_us * 1e-6, r->replay_nodes, r->finished,
+								mp_policyName( b.policy[ i / b.nbr_of_mazes ] ) );
+		}
+		fclose( f );
+	}
+
+	for( i=0; i<runs; i++ ) virtual_s += b.result[i].total_us * 1e-6;
+	for( p=0; p<b.nbr_of_policies; p++ ) finished += batch_summary( &b, p );
+	printf( "\nwall time    %.3f s on %u threads (%.0f runs/s, %.0fx real time)\n",
+					wall, threads, runs / wall, virtual_s / wall );
+
+	if( b.corpus_path != NULL ) corpus_close( &b.corpus );
+	return (finished == runs) ? 0 : 1;
+}
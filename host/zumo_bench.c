@@ -0,0 +1,165 @@
+/**
+	@file	zumo_bench.c
+	@brief	Native benchmark of solver hot paths (host build).
+	@details	Usage: zumo_bench [iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "motorDriver.h"
+#include "zumo_hal_host.h"
+#include "zumo_ledArray.h"
+#include "zumo_maze.h"
+
+/**
+	@brief	Length of line used by ::bench_driveToNode [frames]
+*/
+#define BENCH_LINE_FRAMES 1000
+
+static uint32_t seed = 12345;
+static uint32_t line_left;
+
+/**
+	@brief	Simple LCG, results must not depend on libc.
+*/
+static uint32_t bench_rand(void){
+
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 16;
+}
+
+static double bench_now(void){
+
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+	@brief	World with a straight line under the array, which ends after ::BENCH_LINE_FRAMES.
+*/
+static uint32_t bench_lineSample( void * ctx, uint16_t * raw, uint16_t timeout ){
+
+	uint8_t i;
+	(void)ctx;
+	(void)timeout;
+
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++) raw[i] = 10 + (bench_rand() & 3);
+	if( line_left > 0 ){
+		raw[2] = 80 + (bench_rand() & 7);		// Line under 2 center sensors
+		raw[3] = 80 + (bench_rand() & 7);
+		line_left--;
+	}
+	return 1000;
+}
+
+static void bench_lineAdvance( void * ctx, uint32_t dt_us ){
+
+	(void)ctx;
+	(void)dt_us;
+}
+
+static void bench_calibrate(void){
+
+	uint16_t raw[ HAL_NBR_OF_SENSORS ];
+	uint8_t i;
+
+	la_startCal();
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++) raw[i] = 90;
+	la_frameComplete( raw );
+	la_stopCal();
+}
+
+/**
+	@brief	World with random reflectance under each sensor.
+*/
+static uint32_t bench_randomSample( void * ctx, uint16_t * raw, uint16_t timeout ){
+
+	uint8_t i;
+	(void)ctx;
+	(void)timeout;
+
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++) raw[i] = bench_rand() % 90;
+	return 1000;
+}
+
+static void bench_frame( unsigned long iterations ){
+
+	hal_host_world_t world = { NULL, bench_randomSample, bench_lineAdvance };
+	unsigned long n;
+	unsigned sum = 0;
+	double t;
+
+	hal_host_attach( &world );
+	t = bench_now();
+	for(n=0; n<iterations; n++) sum += la_getSensorState();
+	t = bench_now() - t;
+	hal_host_attach( NULL );
+	printf( "la_getSensorState    %10.1f ns/frame   (checksum %u)\n", t * 1e9 / iterations, sum );
+}
+
+static void bench_routeOptimizer( unsigned long iterations ){
+
+	static NodeArr_t route;
+	static NodeArr_t optimized;
+	static const char moves[] = { 'L', 'S', 'T' };
+	unsigned long n;
+	unsigned sum = 0;
+	uint16_t i;
+	char previous = 'L', reaction;
+	double t;
+
+	// Random full exploration route without 'TT' pairs, ended with 'F'.
+	zm_clearArray( &route );
+	zm_addReaction( previous, &route );
+	for(i=1; i<MAX_NBR_OF_NODES; i++){
+		reaction = moves[ bench_rand() % 3 ];
+		if( reaction == 'T' && previous == 'T' ) reaction = 'L';
+		zm_addReaction( reaction, &route );
+		previous = reaction;
+	}
+	zm_addReaction( 'F', &route );
+
+	t = bench_now();
+	for(n=0; n<iterations; n++){
+		zm_routeOptimizer( &route, &optimized );
+		sum += optimized.length;
+	}
+	t = bench_now() - t;
+	printf( "zm_routeOptimizer    %10.1f ns/route   (%d nodes -> %u, checksum %u)\n", t * 1e9 / iterations, MAX_NBR_OF_NODES, optimized.length, sum );
+}
+
+static void bench_driveToNode( unsigned long iterations ){
+
+	hal_host_world_t world = { NULL, bench_lineSample, bench_lineAdvance };
+	unsigned long n;
+	double t;
+
+	hal_host_attach( &world );
+	t = bench_now();
+	for(n=0; n<iterations; n++){
+		line_left = BENCH_LINE_FRAMES;
+		zm_driveToNode( 45 );
+	}
+	t = bench_now() - t;
+	hal_host_attach( NULL );
+	printf( "zm_driveToNode       %10.1f ns/frame   (%.0fx real time)\n",
+					t * 1e9 / (iterations * BENCH_LINE_FRAMES), (iterations * BENCH_LINE_FRAMES * 1e-3) / t );
+}
+
+int main( int argc, char * argv[] ){
+
+	unsigned long iterations = (argc > 1) ? strtoul( argv[1], NULL, 10 ) : 100000;
+	if( iterations == 0 ) iterations = 1;
+
+	hal_clockInit();
+	motorDriverInit();
+	la_init();
+	bench_calibrate();
+
+	bench_frame( iterations * 10 );
+	bench_routeOptimizer( iterations );
+	bench_driveToNode( iterations / 100 + 1 );
+	return 0;
+}
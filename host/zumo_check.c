@@ -0,0 +1,340 @@
+/**
+	@file	zumo_check.c
+	@brief	Regression checks of solver libraries (host build).
+	@details	Usage: zumo_check. Exit code is the number of failed checks.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "zumo_hal_host.h"
+#include "zumo_ledArray.h"
+#include "zumo_maze.h"
+#include "zumo_map.h"
+#include "zumo_run.h"
+#include "zumo_sim.h"
+
+/**
+	@brief	Number of frames made by ::check_history (ring is overwritten more than twice).
+*/
+#define CHECK_FRAMES 40
+
+/**
+	@brief	Period of frames made by ::check_history [us].
+*/
+#define CHECK_FRAME_US 1000
+
+/**
+	@brief	Number of frames with the line only before node in ::check_node world.
+*/
+#define CHECK_NODE_AT 10
+
+/**
+	@brief	Number of frames with the node under array in ::check_node world.
+*/
+#define CHECK_NODE_FRAMES 4
+
+static int failed = 0;
+
+/**
+	@brief	Function reports one check.
+*/
+static void check( int ok, const char * what, int line ){
+
+	if( !ok ){
+		printf( "FAIL  line %d: %s\n", line, what );
+		failed++;
+	}
+}
+#define CHECK( cond )	check( (cond) ? 1 : 0, #cond, __LINE__ )
+
+/**
+	@brief	Function fills route with reactions given as string (trailing 'F' sets finished flag).
+*/
+static void check_setRoute( NodeArr_t * route, const char * reactions ){
+
+	zm_clearArray( route );
+	while( *reactions ) zm_addReaction( *reactions++, route );
+}
+
+/**
+	@brief	Function returns 1 when route holds reactions given as string.
+*/
+static int check_isRoute( const NodeArr_t * route, const char * reactions ){
+
+	uint16_t i, n = (uint16_t)strlen( reactions );
+
+	for(i=0; i<n; i++){
+		if( zm_reactionAt( route, i ) != reactions[i] ) return 0;
+	}
+	return zm_reactionAt( route, n ) == 0;
+}
+
+static void check_routeOptimizer( void ){
+
+	static NodeArr_t route, optimized;
+
+	// Separate output
+	check_setRoute( &route, "LTLSLTRF" );
+	zm_routeOptimizer( &route, &optimized );
+	CHECK( check_isRoute( &optimized, "SSTF" ) );
+	CHECK( optimized.length == 3 && optimized.cursor == 0 );
+	CHECK( check_isRoute( &route, "LTLSLTRF" ) );
+
+	// The same buffer as input and output
+	zm_routeOptimizer( &route, &route );
+	CHECK( check_isRoute( &route, "SSTF" ) );
+	CHECK( route.length == 3 );
+
+	// Rule result makes next rule
+	check_setRoute( &route, "SLTRLF" );
+	zm_routeOptimizer( &route, &route );
+	CHECK( check_isRoute( &route, "RF" ) );
+
+	// No rule
+	check_setRoute( &route, "LSRS" );
+	zm_routeOptimizer( &route, &route );
+	CHECK( check_isRoute( &route, "LSRS" ) );
+	CHECK( !route.overflow );
+
+	// Full buffer keeps the flag clear, the next reaction is dropped and sets it.
+	zm_clearArray( &route );
+	while( route.length < MAX_NBR_OF_NODES ) zm_addReaction( 'S', &route );
+	CHECK( !route.overflow );
+	zm_addReaction( 'L', &route );
+	CHECK( route.overflow && route.length == MAX_NBR_OF_NODES && zm_reactionAt( &route, MAX_NBR_OF_NODES - 1 ) == 'S' );
+
+	// Truncated route is neither optimized nor saved.
+	zm_addReaction( 'F', &route );
+	zm_routeOptimizer( &route, &optimized );
+	CHECK( optimized.overflow && optimized.length == 0 && zm_reactionAt( &optimized, 0 ) == 0 );
+	optimizedNodeArr = route;
+	CHECK( zr_saveRecord() == 0 );
+	zm_clearArray( &optimizedNodeArr );
+}
+
+/**
+	@brief	Function feeds fresh detector with the same frame until event is confirmed.
+	@return	Return value is confirmed event (0 - none).
+*/
+static uint8_t check_detect( char state ){
+
+	zm_detector_t detector;
+	uint8_t i, event = 0;
+
+	zm_detectorInit( &detector );
+	for(i=0; i<ZM_DEBOUNCE_FRAMES && event == 0; i++) event = zm_detectorStep( &detector, state );
+	return event;
+}
+
+static void check_detector( void ){
+
+	CHECK( check_detect( CENTER ) == ZM_EVENT_LINE );
+	CHECK( check_detect( EMPTY ) == ZM_EVENT_END );
+	CHECK( check_detect( FINISH ) == ZM_EVENT_FINISH );
+	CHECK( check_detect( ALL ) == (ZM_EVENT_LEFT | ZM_EVENT_RIGHT) );
+	CHECK( check_detect( LEFT ) == ZM_EVENT_LEFT );
+	CHECK( check_detect( RIGHT ) == ZM_EVENT_RIGHT );
+
+	// Branch with one more inner sensor on dark
+	CHECK( check_detect( 0x3E ) == ZM_EVENT_LEFT );			// 111110
+	CHECK( check_detect( 0x3D ) == ZM_EVENT_LEFT );			// 111101
+	CHECK( check_detect( 0x2F ) == ZM_EVENT_RIGHT );		// 101111
+	CHECK( check_detect( 0x1F ) == ZM_EVENT_RIGHT );		// 011111
+
+	// Outer sensor alone is not clear yet.
+	CHECK( check_detect( 0x2C ) == 0 );									// 101100
+	CHECK( check_detect( 0x0D ) == 0 );									// 001101
+}
+
+/**
+	@brief	World of ::check_history: sensor 3 is dark with raw value 90 + (seq & 7), sensor 0 is dark only in the last 5 frames.
+*/
+static uint32_t check_historySample( void * ctx, uint16_t * raw, uint16_t timeout ){
+
+	uint32_t seq = la_peekFrameNumber() + 1;
+	uint8_t i;
+	(void)ctx;
+	(void)timeout;
+
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++) raw[i] = 10;
+	raw[3] = 90 + (seq & 7);
+	if( seq > CHECK_FRAMES - 5 ) raw[0] = 100;
+	return CHECK_FRAME_US;
+}
+
+static void check_historyAdvance( void * ctx, uint32_t dt_us ){
+
+	(void)ctx;
+	(void)dt_us;
+}
+
+static void check_history( void ){
+
+	hal_host_world_t world = { NULL, check_historySample, check_historyAdvance };
+	la_cal_t cal;
+	la_frame_t frame;
+	uint32_t seq, sum;
+	uint8_t i;
+
+	hal_host_attach( &world );
+	la_init();
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		cal.min[i] = 10;
+		cal.max[i] = 100;
+	}
+	la_setCal( &cal );
+
+	// No frame yet
+	CHECK( la_historyFrame( 0, &frame ) == 0 );
+	CHECK( la_historyFrame( 1, &frame ) == 0 );
+	CHECK( la_historyAverage( 3, 4 ) == 0 );
+	CHECK( la_historyRate() == 0 );
+	hal_sensorSync();
+	CHECK( la_historyRate() == 0 );
+
+	// Ring is overwritten more than twice.
+	while( la_peekFrameNumber() < CHECK_FRAMES ) hal_sensorSync();
+	seq = la_peekFrameNumber();
+	CHECK( la_historyFrame( seq, &frame ) == 1 && frame.seq == seq && frame.raw[3] == 90 + (seq & 7) );
+	CHECK( la_historyFrame( seq + 1, &frame ) == 0 );
+
+	// Frames up to LA_HISTORY - 2 older than the last one are kept, older ones return 0.
+	CHECK( la_historyFrame( seq - (LA_HISTORY - 2), &frame ) == 1 && frame.seq == seq - (LA_HISTORY - 2) );
+	CHECK( frame.raw[3] == 90 + ((seq - (LA_HISTORY - 2)) & 7) );
+	CHECK( la_historyFrame( seq - (LA_HISTORY - 1), &frame ) == 0 );
+	CHECK( la_historyFrame( seq - LA_HISTORY, &frame ) == 0 );
+	CHECK( la_historyFrame( 1, &frame ) == 0 );
+
+	// Moving average, number of frames is limited to the ring.
+	for(sum=0, i=0; i<4; i++) sum += 90 + ((seq - i) & 7);
+	CHECK( la_historyAverage( 3, 4 ) == sum / 4 );
+	for(sum=0, i=0; i<LA_HISTORY - 1; i++) sum += 90 + ((seq - i) & 7);
+	CHECK( la_historyAverage( 3, 200 ) == sum / (LA_HISTORY - 1) );
+
+	// Sensor 0 became dark 4 frames ago, centre sensors did not change.
+	CHECK( la_historyAge( 0x20 ) == 4 );
+	CHECK( la_historyAge( 0x0C ) == LA_HISTORY_AGE_MAX );
+
+	// Line under sensor 3 only, then sensor 0 is dark too (centroid is divided by reader of frame).
+	CHECK( la_historyFrame( seq - 5, &frame ) == 1 && la_framePosition( &frame ) == 3000 );
+	CHECK( la_historyFrame( seq, &frame ) == 1 && la_framePosition( &frame ) > 1000 && la_framePosition( &frame ) < 2000 );
+	CHECK( la_peekLinePosition() == la_framePosition( &frame ) );
+
+	CHECK( la_historyRate() == 1000000 / CHECK_FRAME_US );
+	hal_host_attach( NULL );
+}
+
+/**
+	@brief	World of ::check_node: line, then left turn (ctx points to the first frame number), then nothing.
+*/
+static uint32_t check_nodeSample( void * ctx, uint16_t * raw, uint16_t timeout ){
+
+	uint32_t frame = la_peekFrameNumber() + 1 - *(uint32_t *)ctx;
+	char state = frame < CHECK_NODE_AT ? CENTER : frame < CHECK_NODE_AT + CHECK_NODE_FRAMES ? LEFT : EMPTY;
+	uint8_t i;
+	(void)timeout;
+
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++) raw[i] = (state & (0x20 >> i)) ? 100 : 10;
+	return CHECK_FRAME_US;
+}
+
+static void check_node( void ){
+
+	uint32_t first;
+	hal_host_world_t world = { &first, check_nodeSample, check_historyAdvance };
+	la_cal_t cal;
+	uint8_t i;
+
+	hal_host_attach( &world );
+	la_init();
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		cal.min[i] = 10;
+		cal.max[i] = 100;
+	}
+	la_setCal( &cal );
+
+	// Crossroad is expected, but there is only a turn: it is checked from arrival event (not as dead end seen behind it).
+	first = la_peekFrameNumber() + 1;
+	zm_driveProfiled( 30, 30, 0, 1 );
+	CHECK( zm_passNode( FULL_CROSS, 'S', 30 ) == 0 );
+	CHECK( zm_checkNode( 30 ) == LEFT_TURN );
+	hal_host_attach( NULL );
+}
+
+static void check_replay( void ){
+
+	static sim_maze_t maze;
+	sim_result_t result;
+
+	// Route to the right branch is saved in flash (kept in memory).
+	hal_host_setFlashFile( NULL );
+	CHECK( sim_parseMaze( &maze, "+-+-F\n  |\n  S\n" ) == 0 );
+	CHECK( sim_run( &maze, MP_LEFT_HAND, 1, 1200000000ull, NULL, &result ) == 0 && result.explored && !result.stored );
+
+	// Other maze with the same first node: dead end where 'F' is expected stops replay, so maze is explored.
+	CHECK( sim_parseMaze( &maze, "F-+-+\n  |\n  S\n" ) == 0 );
+	CHECK( sim_run( &maze, MP_LEFT_HAND, 1, 1200000000ull, NULL, &result ) == 0 && result.explored && !result.stored );
+}
+
+/**
+	@brief	Function drives straight for given time and arrives at crossroad (map of ::check_map).
+*/
+static void check_mapDrive( char reaction, uint32_t time_ms ){
+
+	mp_leave( reaction );
+	hal_delayMs( time_ms );
+	mp_arrive( FULL_CROSS );
+}
+
+static void check_map( void ){
+
+	static NodeArr_t route;
+	static mp_profile_t profile;
+	uint8_t e;
+
+	hal_host_attach( NULL );
+	la_init();
+
+	// Start - A - E, then square of left turns back to A from its unknown branch: the loop is closed.
+	mp_init();
+	hal_delayMs( 1000 );
+	mp_arrive( FULL_CROSS );
+	check_mapDrive( 'S', 1000 );
+	check_mapDrive( 'L', 1000 );
+	check_mapDrive( 'L', 1000 );
+	check_mapDrive( 'L', 1000 );
+	CHECK( zumoMap.nbr_of_nodes == 5 && zumoMap.loops == 1 && zumoMap.node[1].edge[1] == 4 && !zumoMap.conflict );
+
+	// Start - A, then square of left turns back to A in the start heading. Its branch towards start is known,
+	// so it is another crossroad at the same position, and edge from start is kept.
+	mp_init();
+	hal_delayMs( 1000 );
+	mp_arrive( FULL_CROSS );
+	e = zumoMap.node[1].edge[2];
+	check_mapDrive( 'L', 1000 );
+	check_mapDrive( 'L', 1000 );
+	check_mapDrive( 'L', 1000 );
+	check_mapDrive( 'L', 1000 );
+	CHECK( zumoMap.node[1].edge[2] == e && zumoMap.edge[e].node[0] == 0 );
+	CHECK( zumoMap.nbr_of_nodes == 6 && zumoMap.loops == 0 && !zumoMap.conflict );
+
+	// Finish in start node - only 'F'.
+	mp_init();
+	zumoMap.finish = 0;
+	CHECK( mp_plan( &route, &profile ) == 1 && check_isRoute( &route, "F" ) );
+}
+
+int main( void ){
+
+	hal_clockInit();
+
+	check_routeOptimizer();
+	check_detector();
+	check_history();
+	check_node();
+	check_map();
+	check_replay();
+
+	printf( "%s: %d failed\n", failed ? "FAIL" : "ok", failed );
+	return failed;
+}
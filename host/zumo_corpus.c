@@ -0,0 +1,279 @@
+/**
+	@file	zumo_corpus.c
+	@brief	Procedural maze generator and packed binary maze corpus (host build).
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "zumo_corpus.h"
+
+#define CORPUS_MAX_POINTS ( CORPUS_MAX_SIDE * CORPUS_MAX_SIDE )
+
+static const int corpus_dx[4] = { 1, 0, -1, 0 };		// east, north, west, south
+static const int corpus_dy[4] = { 0, -1, 0, 1 };
+
+
+size_t corpus_mazeSize( uint8_t width, uint8_t height ){
+
+	size_t size = sizeof( corpus_maze_t ) + ((size_t)width * height + 3) / 4;
+	return (size + 7) & ~(size_t)7;
+}
+
+static uint32_t corpus_rand( uint32_t * rng, uint32_t n ){
+
+	*rng = *rng * 1664525u + 1013904223u;
+	return (*rng >> 8) % n;
+}
+
+/**
+	@brief	Function checks if grid point is linked in given direction (0 - east, 1 - north, 2 - west, 3 - south).
+*/
+static uint8_t corpus_linked( const corpus_maze_t * m, int x, int y, uint8_t dir ){
+
+	int nx = x + corpus_dx[dir], ny = y + corpus_dy[dir];
+
+	if( nx < 0 || ny < 0 || nx >= m->width || ny >= m->height ) return 0;
+	switch( dir ){
+		case 0: return corpus_cell( m, x, y ) & CORPUS_EAST;
+		case 3: return (corpus_cell( m, x, y ) & CORPUS_SOUTH) >> 1;
+		default: return corpus_cell( m, nx, ny ) & (dir == 2 ? CORPUS_EAST : CORPUS_SOUTH) ? 1 : 0;
+	}
+}
+
+static uint8_t corpus_degree( const corpus_maze_t * m, int x, int y ){
+
+	uint8_t d, n = 0;
+
+	for( d=0; d<4; d++ ) n += corpus_linked( m, x, y, d );
+	return n;
+}
+
+/**
+	@brief	Function links grid point with its neighbour in given direction.
+*/
+static void corpus_link( corpus_maze_t * m, int x, int y, uint8_t dir ){
+
+	uint8_t * cells = (uint8_t *)(m + 1);
+	uint8_t bit = CORPUS_EAST;
+	unsigned i;
+
+	// West and north links are stored in the neighbour.
+	if( dir == 1 || dir == 2 ){
+		x += corpus_dx[dir];
+		y += corpus_dy[dir];
+		dir ^= 2;
+	}
+	if( dir == 3 ) bit = CORPUS_SOUTH;
+	i = y * m->width + x;
+	cells[ i >> 2 ] |= bit << ((i & 3) * 2);
+	m->nbr_of_links++;
+}
+
+/**
+	@brief	Function finds distance (in links) of every grid point from given one (breadth-first search).
+*/
+static void corpus_distances( const corpus_maze_t * m, int x, int y, uint16_t * dist ){
+
+	uint16_t queue[ CORPUS_MAX_POINTS ];
+	unsigned head = 0, tail = 0, i;
+	uint8_t d;
+
+	for( i=0; i<(unsigned)m->width * m->height; i++ ) dist[i] = UINT16_MAX;
+	dist[ y * m->width + x ] = 0;
+	queue[ tail++ ] = y * m->width + x;
+
+	while( head < tail ){
+		unsigned p = queue[ head++ ];
+		int px = p % m->width, py = p / m->width;
+		for( d=0; d<4; d++ ){
+			unsigned n = (py + corpus_dy[d]) * m->width + px + corpus_dx[d];
+			if( corpus_linked( m, px, py, d ) && dist[n] == UINT16_MAX ){
+				dist[n] = dist[p] + 1;
+				queue[ tail++ ] = n;
+			}
+		}
+	}
+}
+
+int corpus_generate( corpus_maze_t * m, uint8_t width, uint8_t height, uint8_t loops, uint32_t * rng ){
+
+	uint16_t stack[ CORPUS_MAX_POINTS ];
+	uint16_t dist[ CORPUS_MAX_POINTS ];
+	uint8_t visited[ CORPUS_MAX_POINTS ];
+	unsigned points = (unsigned)width * height;
+	unsigned top = 0, i, dead_ends = 0, extra, tries;
+	unsigned start, finish;
+
+	if( width < CORPUS_MIN_SIDE || height < CORPUS_MIN_SIDE || width > CORPUS_MAX_SIDE || height > CORPUS_MAX_SIDE ) return -1;
+
+	memset( m, 0, corpus_mazeSize( width, height ) );
+	m->width = width;
+	m->height = height;
+	memset( visited, 0, points );
+
+	// Spanning tree - randomized depth-first search
+	i = corpus_rand( rng, points );
+	visited[i] = 1;
+	stack[ top++ ] = i;
+	while( top > 0 ){
+		unsigned p = stack[ top-1 ];
+		int px = p % width, py = p / width;
+		uint8_t next[4], n = 0, d;
+
+		for( d=0; d<4; d++ ){
+			int nx = px + corpus_dx[d], ny = py + corpus_dy[d];
+			if( nx >= 0 && ny >= 0 && nx < width && ny < height && !visited[ ny * width + nx ] ) next[ n++ ] = d;
+		}
+		if( n == 0 ){
+			top--;
+			continue;
+		}
+		d = next[ corpus_rand( rng, n ) ];
+		corpus_link( m, px, py, d );
+		i = (py + corpus_dy[d]) * width + px + corpus_dx[d];
+		visited[i] = 1;
+		stack[ top++ ] = i;
+	}
+
+	// Start - random dead end, finish - the dead end farthest from start
+	for( i=0; i<points; i++ ) dead_ends += (corpus_degree( m, i % width, i / width ) == 1);
+	extra = corpus_rand( rng, dead_ends );
+	for( start=0; start<points; start++ ){
+		if( corpus_degree( m, start % width, start / width ) == 1 && extra-- == 0 ) break;
+	}
+	corpus_distances( m, start % width, start / width, dist );
+	finish = start;
+	for( i=0; i<points; i++ ){
+		if( i != start && corpus_degree( m, i % width, i / width ) == 1 && (finish == start || dist[i] > dist[finish]) ) finish = i;
+	}
+	m->start_x = start % width;
+	m->start_y = start / width;
+	m->finish_x = finish % width;
+	m->finish_y = finish / width;
+
+	// Loops - extra links which do not touch start and finish
+	extra = points * loops / 100;
+	for( tries = 0; extra > 0 && tries < 20 * points; tries++ ){
+		unsigned p = corpus_rand( rng, points );
+		int px = p % width, py = p / width;
+		uint8_t d = corpus_rand( rng, 2 ) ? 3 : 0;
+		unsigned n = (py + corpus_dy[d]) * width + px + corpus_dx[d];
+
+		if( px + corpus_dx[d] >= width || py + corpus_dy[d] >= height ) continue;
+		if( p == start || p == finish || n == start || n == finish ) continue;
+		if( corpus_linked( m, px, py, d ) ) continue;
+		corpus_link( m, px, py, d );
+		extra--;
+	}
+	return 0;
+}
+
+void corpus_count( const corpus_maze_t * m, corpus_stats_t * stats ){
+
+	int x, y;
+
+	stats->mazes++;
+	stats->loops += m->nbr_of_links + 1 - (unsigned)m->width * m->height;
+	for( y=0; y<m->height; y++ ){
+		for( x=0; x<m->width; x++ ){
+			uint8_t degree = corpus_degree( m, x, y );
+			if( degree == 4 ) stats->crosses++;
+			else if( degree == 3 ) stats->junctions++;
+			else if( degree == 2 ){
+				if( corpus_linked( m, x, y, 0 ) == corpus_linked( m, x, y, 2 ) ) stats->straights++;
+				else stats->turns++;
+			}
+			else if( degree == 1 && !(x == m->start_x && y == m->start_y) && !(x == m->finish_x && y == m->finish_y) ) stats->dead_ends++;
+		}
+	}
+}
+
+void corpus_print( const corpus_maze_t * m, FILE * f ){
+
+	int x, y;
+
+	for( y=0; y<m->height; y++ ){
+		for( x=0; x<m->width; x++ ){
+			char g = '+';
+			if( x == m->start_x && y == m->start_y ) g = 'S';
+			if( x == m->finish_x && y == m->finish_y ) g = 'F';
+			fputc( g, f );
+			if( x+1 < m->width ) fputc( corpus_linked( m, x, y, 0 ) ? '-' : ' ', f );
+		}
+		fputc( '\n', f );
+		if( y+1 < m->height ){
+			for( x=0; x<m->width; x++ ){
+				fputc( corpus_linked( m, x, y, 3 ) ? '|' : ' ', f );
+				if( x+1 < m->width ) fputc( ' ', f );
+			}
+			fputc( '\n', f );
+		}
+	}
+}
+
+int corpus_open( corpus_t * c, const char * path ){
+
+	struct stat st;
+	void * base;
+	int fd = open( path, O_RDONLY );
+
+	memset( c, 0, sizeof( *c ) );
+	if( fd < 0 ) return -1;
+	if( fstat( fd, &st ) || (size_t)st.st_size < sizeof( corpus_header_t ) ){
+		close( fd );
+		return -1;
+	}
+	base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( base == MAP_FAILED ) return -1;
+
+	c->base = base;
+	c->size = st.st_size;
+	c->header = base;
+	if( c->header->magic != CORPUS_MAGIC || c->header->size != c->size
+		|| c->header->index_offset + (uint64_t)c->header->nbr_of_mazes * sizeof( uint64_t ) > c->size ){
+		corpus_close( c );
+		return -1;
+	}
+	c->index = (const uint64_t *)(c->base + c->header->index_offset);
+	return 0;
+}
+
+void corpus_close( corpus_t * c ){
+
+	if( c->base != NULL ) munmap( (void *)c->base, c->size );
+	memset( c, 0, sizeof( *c ) );
+}
+
+const corpus_maze_t * corpus_get( const corpus_t * c, uint32_t n ){
+
+	const corpus_maze_t * m;
+
+	if( n >= c->header->nbr_of_mazes || c->index[n] + sizeof( corpus_maze_t ) > c->size ) return NULL;
+	m = (const corpus_maze_t *)(c->base + c->index[n]);
+	if( c->index[n] + corpus_mazeSize( m->width, m->height ) > c->size ) return NULL;
+	return m;
+}
+
+int corpus_render( const corpus_maze_t * m, sim_maze_t * maze ){
+
+	int x, y;
+	uint8_t d;
+
+	sim_clearMaze( maze );
+	for( y=0; y<m->height; y++ ){
+		for( x=0; x<m->width; x++ ){
+			uint8_t cell = corpus_cell( m, x, y );
+			if( (cell & CORPUS_EAST) && sim_addGridLink( maze, x, y, 0 ) ) return -1;
+			if( (cell & CORPUS_SOUTH) && sim_addGridLink( maze, x, y, 1 ) ) return -1;
+		}
+	}
+	for( d=0; d<4; d++ ){
+		if( corpus_linked( m, m->start_x, m->start_y, d ) ) sim_setGridStart( maze, m->start_x, m->start_y, d );
+		if( corpus_linked( m, m->finish_x, m->finish_y, d ) && sim_addGridFinish( maze, m->finish_x, m->finish_y, d ) ) return -1;
+	}
+	return 0;
+}
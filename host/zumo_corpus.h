@@ -0,0 +1,149 @@
+/**
+	@file	zumo_corpus.h
+	@brief	Procedural maze generator and packed binary maze corpus (host build).
+	@details	Corpus file layout (little-endian, every part aligned to 8 bytes):
+						<ul>
+							<li> ::corpus_header_t
+							<li> index - offset of each maze from the beginning of file (uint64_t)
+							<li> mazes - ::corpus_maze_t followed by cell bitfield
+						</ul>
+						Maze is a grid of points connected with tape. Every cell holds two bits: ::CORPUS_EAST and ::CORPUS_SOUTH
+						link, four cells in one byte, row by row. Start and finish are dead ends of the grid (exactly one link),
+						finish marker is placed after the finish point, like 'F' in text mazes (see ::sim_parseMaze).
+						File is mapped to memory, so maze N is available without reading or parsing the whole corpus.
+*/
+#ifndef ZUMO_CORPUS_H_
+#define ZUMO_CORPUS_H_
+#include <stddef.h>
+#include <stdint.h>
+#include "zumo_sim.h"
+
+/**
+	@brief	Magic number at the beginning of corpus file ("ZMC1").
+*/
+#define CORPUS_MAGIC 0x31434d5au
+
+/**
+	@brief	Smallest and largest side of generated maze [grid points].
+*/
+#define CORPUS_MIN_SIDE 3
+#define CORPUS_MAX_SIDE 64
+
+/**
+	@brief	Link bits of one cell.
+*/
+#define CORPUS_EAST		0x01
+#define CORPUS_SOUTH	0x02
+
+/**
+	@brief	Corpus file header.
+*/
+typedef struct{
+	uint32_t magic;						/**< ::CORPUS_MAGIC */
+	uint32_t nbr_of_mazes;		/**< Number of entries in index */
+	uint32_t seed;						/**< Seed used by generator */
+	uint32_t reserved;
+	uint64_t index_offset;		/**< Offset of maze index */
+	uint64_t size;						/**< Size of whole file */
+} corpus_header_t;
+
+/**
+	@brief	Header of one maze. Cell bitfield (::corpus_cells) follows it directly.
+*/
+typedef struct{
+	uint8_t width, height;					/**< Size [grid points] */
+	uint8_t start_x, start_y;				/**< Start point (x - column, y - row from the top) */
+	uint8_t finish_x, finish_y;			/**< Finish point */
+	uint16_t nbr_of_links;					/**< Number of tape connections */
+} corpus_maze_t;
+
+/**
+	@brief	Corpus mapped to memory.
+*/
+typedef struct{
+	const uint8_t * base;						/**< Beginning of mapped file */
+	size_t size;										/**< Size of mapping */
+	const corpus_header_t * header;
+	const uint64_t * index;
+} corpus_t;
+
+/**
+	@brief	Statistics of generated mazes (grid point kinds).
+*/
+typedef struct{
+	uint32_t mazes;
+	uint64_t crosses;					/**< Four links */
+	uint64_t junctions;				/**< Three links (T-junctions) */
+	uint64_t turns;						/**< Two links at right angle */
+	uint64_t straights;				/**< Two links on a line (no node) */
+	uint64_t dead_ends;				/**< One link (start and finish excluded) */
+	uint64_t loops;						/**< Independent cycles (links - points + 1) */
+} corpus_stats_t;
+
+
+/**
+	@brief	Function returns pointer to cell bitfield of maze.
+*/
+static inline const uint8_t * corpus_cells( const corpus_maze_t * m ){
+	return (const uint8_t *)(m + 1);
+}
+
+/**
+	@brief	Function returns links (::CORPUS_EAST, ::CORPUS_SOUTH) of grid point.
+*/
+static inline uint8_t corpus_cell( const corpus_maze_t * m, unsigned x, unsigned y ){
+	unsigned i = y * m->width + x;
+	return (corpus_cells( m )[ i >> 2 ] >> ((i & 3) * 2)) & 3;
+}
+
+/**
+	@brief	Function returns size of maze record with bitfield, padded to 8 bytes.
+*/
+size_t corpus_mazeSize( uint8_t width, uint8_t height );
+
+/**
+	@brief	Function generates random maze.
+	@details	Spanning tree is made by depth-first search (randomized backtracker), then extra links
+						are added to make loops. Start is a random dead end and finish is the dead end farthest from it.
+	@param[out]	m Maze record, ::corpus_mazeSize bytes.
+	@param	width,height Size in range ::CORPUS_MIN_SIDE - ::CORPUS_MAX_SIDE.
+	@param	loops Extra links in percent of grid points.
+	@param	rng State of random generator.
+	@return	Return value is 0 on success, -1 on invalid size.
+*/
+int corpus_generate( corpus_maze_t * m, uint8_t width, uint8_t height, uint8_t loops, uint32_t * rng );
+
+/**
+	@brief	Function adds maze grid point kinds to statistics.
+*/
+void corpus_count( const corpus_maze_t * m, corpus_stats_t * stats );
+
+/**
+	@brief	Function prints maze in text format of ::sim_parseMaze.
+*/
+void corpus_print( const corpus_maze_t * m, FILE * f );
+
+/**
+	@brief	Function maps corpus file to memory.
+	@return	Return value is 0 on success, -1 when file cannot be mapped or has invalid header.
+*/
+int corpus_open( corpus_t * c, const char * path );
+
+/**
+	@brief	Function unmaps corpus file.
+*/
+void corpus_close( corpus_t * c );
+
+/**
+	@brief	Function returns maze N from mapped corpus.
+	@return	Return value is NULL when index or maze record is out of file.
+*/
+const corpus_maze_t * corpus_get( const corpus_t * c, uint32_t n );
+
+/**
+	@brief	Function draws maze as tape segments for simulator.
+	@return	Return value is 0 on success, -1 when maze does not fit in ::sim_maze_t.
+*/
+int corpus_render( const corpus_maze_t * m, sim_maze_t * maze );
+
+#endif
@@ -0,0 +1,238 @@
+/**
+	@file	zumo_hal_host.c
+	@brief	Hardware abstraction layer - x86-64 Linux (host) backend
+*/
+
+#include <string.h>
+#include "zumo_hal_host.h"
+#include "zumo_hal.h"
+#include "zumo_ledArray.h"
+#include "zumo_maze.h"
+#include "bluetooth.h"
+
+/**
+	@brief	Frame period used when there is no world attached.
+*/
+#define HAL_HOST_IDLE_FRAME_US 1000
+
+/**
+	@brief	Discharge time used when there is no world attached (white board).
+*/
+#define HAL_HOST_IDLE_RAW 10
+
+// Backend state (one robot per thread)
+static HAL_STATE const hal_host_world_t * world = NULL;
+static HAL_STATE uint64_t now_us = 0;
+static HAL_STATE int16_t motor[2];
+static HAL_STATE FILE * uart_sink = NULL;
+static HAL_STATE uint8_t flash[ HAL_FLASH_SECTOR_SIZE ];
+static HAL_STATE uint8_t flash_ready = 0;				// 0 - flash was not erased yet (fresh board)
+static HAL_STATE const char * flash_path = NULL;
+static HAL_STATE uint32_t control_period_us = 0;		// 0 - control timer is stopped
+static HAL_STATE uint64_t control_next_us;
+
+
+void hal_host_attach( const hal_host_world_t * new_world ){
+
+	world = new_world;
+	now_us = 0;
+	control_period_us = 0;
+	motor[HAL_MOTOR_LEFT] = 0;
+	motor[HAL_MOTOR_RIGHT] = 0;
+}
+
+int16_t hal_host_getMotor( hal_motor_t m ){
+
+	return motor[m];
+}
+
+uint64_t hal_host_micros(void){
+
+	return now_us;
+}
+
+void hal_host_setUartSink( FILE * sink ){
+
+	uart_sink = sink;
+}
+
+
+int hal_host_setFlashFile( const char * path ){
+
+	FILE * f;
+	int err = 0;
+
+	memset( flash, 0xff, sizeof( flash ) );
+	flash_ready = 1;
+	flash_path = path;
+	if( path == NULL ) return 0;
+
+	// Missing file is an erased sector.
+	f = fopen( path, "rb" );
+	if( f == NULL ) return 0;
+	if( fread( flash, 1, sizeof( flash ), f ) != sizeof( flash ) ) err = -1;
+	fclose( f );
+	return err;
+}
+
+/**
+	@brief	Function writes sector back to its file.
+*/
+static int8_t hal_host_storeFlash(void){
+
+	FILE * f;
+
+	if( flash_path == NULL ) return 0;
+	f = fopen( flash_path, "wb" );
+	if( f == NULL ) return -1;
+	if( fwrite( flash, 1, sizeof( flash ), f ) != sizeof( flash ) ){
+		fclose( f );
+		return -1;
+	}
+	return fclose( f ) ? -1 : 0;
+}
+
+
+/**
+	@brief	Function moves virtual clock (and the world) forward and fires control ticks on the way.
+*/
+static void hal_host_move( uint32_t dt_us ){
+
+	uint64_t end = now_us + dt_us;
+
+	while( control_period_us != 0 && control_next_us <= end ){
+		if( world != NULL ) world->advance( world->ctx, (uint32_t)(control_next_us - now_us) );
+		now_us = control_next_us;
+		control_next_us += control_period_us;
+		zm_controlTick();
+	}
+	if( world != NULL ) world->advance( world->ctx, (uint32_t)(end - now_us) );
+	now_us = end;
+}
+
+
+void hal_sensorInit(void){
+	// Nothing to prepare - frames are produced on demand.
+}
+
+void hal_sensorSync(void){
+
+	uint16_t raw[ HAL_NBR_OF_SENSORS ];
+	uint32_t period;
+	uint8_t i;
+
+	// Sample the world at the beginning of the frame (frame is closed at timeout like sensor timer does)...
+	if( world != NULL ) period = world->sample( world->ctx, raw, la_frameTimeout() );
+	else{
+		for(i=0; i<HAL_NBR_OF_SENSORS; i++) raw[i] = HAL_HOST_IDLE_RAW;
+		period = HAL_HOST_IDLE_FRAME_US;
+	}
+
+	// ... let it move while capacitors discharge ...
+	hal_host_move( period );
+
+	// ... and publish it like the interrupt does.
+	la_frameComplete( raw );
+}
+
+
+void hal_motorInit(void){
+
+	motor[HAL_MOTOR_LEFT] = 0;
+	motor[HAL_MOTOR_RIGHT] = 0;
+}
+
+void hal_motorWrite( hal_motor_t m, uint8_t reverse, uint16_t duty ){
+
+	if( duty > HAL_PWM_MOD ) duty = HAL_PWM_MOD;
+	motor[m] = reverse ? -(int16_t)duty : (int16_t)duty;
+}
+
+
+void hal_uartInit( uint32_t baud_rate ){
+
+	(void)baud_rate;
+}
+
+void hal_uartKick(void){
+
+	// Transmitter is infinitely fast.
+	while( !buf_empty(&TxBuf) ){
+
+		char c = from_UART_buffer( &TxBuf );
+		// Terminal friendly output: CR is a new line, string terminators are dropped.
+		if( uart_sink != NULL && c != '\0' ) fputc( c == '\r' ? '\n' : c, uart_sink );
+	}
+}
+
+
+void hal_clockInit(void){
+
+	now_us = 0;
+}
+
+uint32_t hal_millis(void){
+
+	return (uint32_t)(now_us / 1000);
+}
+
+uint32_t hal_micros(void){
+
+	return (uint32_t)now_us;
+}
+
+void hal_delayMs( uint32_t value ){
+
+	uint64_t end = now_us + (uint64_t)value * 1000;
+
+	// Interrupts keep producing frames while the target is waiting.
+	while( now_us < end ) hal_sensorSync();
+}
+
+
+void hal_controlStart( uint16_t rate_hz ){
+
+	control_period_us = 1000000ul / rate_hz;
+	control_next_us = now_us + control_period_us;
+}
+
+void hal_controlStop(void){
+
+	control_period_us = 0;
+}
+
+
+void hal_stackPaint(void){
+}
+
+uint16_t hal_stackUsed(void){
+
+	return 0;
+}
+
+
+const uint8_t * hal_flashSector(void){
+
+	if( !flash_ready ) hal_host_setFlashFile( NULL );
+	return flash;
+}
+
+int8_t hal_flashErase(void){
+
+	memset( flash, 0xff, sizeof( flash ) );
+	flash_ready = 1;
+	return hal_host_storeFlash();
+}
+
+int8_t hal_flashWrite( uint32_t offset, const void * data, uint32_t size ){
+
+	const uint8_t * bytes = data;
+	uint32_t i;
+
+	if( (offset & 3) || (size & 3) || offset + size > HAL_FLASH_SECTOR_SIZE ) return -1;
+	if( !flash_ready ) hal_host_setFlashFile( NULL );
+
+	// Like NOR flash, programming only clears bits.
+	for( i=0; i<size; i++ ) flash[ offset + i ] &= bytes[i];
+	return hal_host_storeFlash();
+}
@@ -0,0 +1,56 @@
+/**
+	@file	zumo_hal_host.h
+	@brief	Hardware abstraction layer - x86-64 Linux (host) backend
+	@details	Time is virtual. It moves forward only when sensor frame is produced (::hal_sensorSync, ::hal_delayMs),
+						so solver code runs as fast as host CPU allows.
+						Control timer ticks (::hal_controlStart) are fired at their virtual time while the world moves. World model (simulator) is attached with ::hal_host_attach.
+*/
+#ifndef ZUMO_HAL_HOST_H_
+#define ZUMO_HAL_HOST_H_
+#include <stdint.h>
+#include <stdio.h>
+#include "zumo_hal.h"
+
+/**
+	@brief	World model driven by host backend.
+*/
+typedef struct{
+	void * ctx;																				/**< User context passed to callbacks */
+	uint32_t	(*sample)( void * ctx, uint16_t * raw, uint16_t timeout );		/**< Sample discharge times of each sensor, longer ones are cut to timeout (::la_frameTimeout). Return value is frame period [us] */
+	void			(*advance)( void * ctx, uint32_t dt_us );		/**< Move the world forward */
+} hal_host_world_t;
+
+/**
+	@brief	Function attaches world model to host backend and resets virtual clock.
+	@param	world Pointer to world model. NULL detaches it (white board, 1 ms frames).
+*/
+void hal_host_attach( const hal_host_world_t * world );
+
+/**
+	@brief	Function returns signed motor duty written by solver.
+	@param	motor Selected motor.
+	@return	Return value is duty in range -::HAL_PWM_MOD - ::HAL_PWM_MOD (negative means reverse).
+*/
+int16_t hal_host_getMotor( hal_motor_t motor );
+
+/**
+	@brief	Function returns virtual time.
+	@return	Return value is time in microseconds.
+*/
+uint64_t hal_host_micros(void);
+
+/**
+	@brief	Function selects where transmitted UART bytes are written.
+	@param	sink Output stream. NULL drops every byte.
+*/
+void hal_host_setUartSink( FILE * sink );
+
+/**
+	@brief	Function selects file which keeps record flash sector between runs (like flash of the board between resets).
+	@details	Sector is read from the file now and written back after each erase or write. Missing file is an erased sector.
+	@param	path File path. NULL gives erased sector kept only in memory (fresh board).
+	@return	Return value is 0 on success, -1 when file is shorter than ::HAL_FLASH_SECTOR_SIZE.
+*/
+int hal_host_setFlashFile( const char * path );
+
+#endif
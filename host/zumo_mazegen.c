@@ -0,0 +1,104 @@
+/**
+	@file	zumo_mazegen.c
+	@brief	Generates corpus of random mazes (host build).
+	@details	Usage: zumo_mazegen [-n count] [-s seed] [-m min_side] [-M max_side] [-l loops] [-p] corpus.bin
+						<ul>
+							<li> -n - number of mazes
+							<li> -s - seed of generator (the same seed gives the same corpus)
+							<li> -m, -M - range of maze width and height in grid points (3 - 64)
+							<li> -l - extra links making loops, in percent of grid points
+							<li> -p - print mazes in text format (see zumo_sim.h) to standard output
+						</ul>
+						File format is described in zumo_corpus.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zumo_corpus.h"
+
+int main( int argc, char * argv[] ){
+
+	uint32_t count = 1000, seed = 1, rng, i;
+	unsigned min_side = CORPUS_MIN_SIDE, max_side = CORPUS_MAX_SIDE, loops = 10;
+	int print = 0, a;
+	const char * path = NULL;
+	corpus_header_t header;
+	corpus_stats_t stats;
+	uint64_t * index;
+	corpus_maze_t * m;
+	uint64_t offset;
+	FILE * f;
+
+	for( a=1; a<argc; a++ ){
+		if( strcmp( argv[a], "-n" ) == 0 && a+1 < argc ) count = strtoul( argv[++a], NULL, 10 );
+		else if( strcmp( argv[a], "-s" ) == 0 && a+1 < argc ) seed = strtoul( argv[++a], NULL, 10 );
+		else if( strcmp( argv[a], "-m" ) == 0 && a+1 < argc ) min_side = strtoul( argv[++a], NULL, 10 );
+		else if( strcmp( argv[a], "-M" ) == 0 && a+1 < argc ) max_side = strtoul( argv[++a], NULL, 10 );
+		else if( strcmp( argv[a], "-l" ) == 0 && a+1 < argc ) loops = strtoul( argv[++a], NULL, 10 );
+		else if( strcmp( argv[a], "-p" ) == 0 ) print = 1;
+		else if( argv[a][0] == '-' || path != NULL ) break;		// unknown option or second path
+		else path = argv[a];
+	}
+	if( a < argc || path == NULL || count == 0 || min_side < CORPUS_MIN_SIDE || max_side > CORPUS_MAX_SIDE || min_side > max_side || loops > 100 ){
+		fprintf( stderr, "usage: %s [-n count] [-s seed] [-m min_side] [-M max_side] [-l loops] [-p] corpus.bin\n", argv[0] );
+		return 2;
+	}
+
+	f = fopen( path, "wb" );
+	if( f == NULL ){
+		fprintf( stderr, "%s: cannot write corpus\n", path );
+		return 2;
+	}
+	index = calloc( count, sizeof( uint64_t ) );
+	m = malloc( corpus_mazeSize( CORPUS_MAX_SIDE, CORPUS_MAX_SIDE ) );
+	memset( &stats, 0, sizeof( stats ) );
+
+	// Header and index are written again when offsets are known.
+	memset( &header, 0, sizeof( header ) );
+	header.magic = CORPUS_MAGIC;
+	header.nbr_of_mazes = count;
+	header.seed = seed;
+	header.index_offset = sizeof( header );
+	offset = header.index_offset + count * sizeof( uint64_t );
+	fseek( f, offset, SEEK_SET );
+
+	rng = seed;
+	for( i=0; i<count; i++ ){
+		uint8_t width, height;
+		size_t size;
+
+		rng = rng * 1664525u + 1013904223u;
+		width = min_side + (rng >> 8) % (max_side - min_side + 1);
+		rng = rng * 1664525u + 1013904223u;
+		height = min_side + (rng >> 8) % (max_side - min_side + 1);
+		corpus_generate( m, width, height, loops, &rng );
+		corpus_count( m, &stats );
+		if( print ){
+			printf( "# maze %u, %ux%u\n", i, m->width, m->height );
+			corpus_print( m, stdout );
+		}
+
+		size = corpus_mazeSize( m->width, m->height );
+		index[i] = offset;
+		fwrite( m, 1, size, f );
+		offset += size;
+	}
+
+	header.size = offset;
+	fseek( f, 0, SEEK_SET );
+	fwrite( &header, sizeof( header ), 1, f );
+	fwrite( index, sizeof( uint64_t ), count, f );
+	if( fclose( f ) ){
+		fprintf( stderr, "%s: cannot write corpus\n", path );
+		return 2;
+	}
+
+	fprintf( stderr, "%u mazes, %.1f kB\n", count, offset / 1024.0 );
+	fprintf( stderr, "crosses %lu, T-junctions %lu, turns %lu, dead ends %lu, loops %lu\n",
+						(unsigned long)stats.crosses, (unsigned long)stats.junctions, (unsigned long)stats.turns,
+						(unsigned long)stats.dead_ends, (unsigned long)stats.loops );
+	free( m );
+	free( index );
+	return 0;
+}
@@ -0,0 +1,163 @@
+/**
+	@file	zumo_pool.c
+	@brief	Work-stealing thread pool for batch simulations (host build).
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "zumo_pool.h"
+
+/**
+	@brief	Range of tasks owned by one worker.
+*/
+typedef struct{
+	pthread_mutex_t lock;
+	uint32_t next;					/**< Next task taken by the owner */
+	uint32_t end;						/**< End of range (thieves take from here) */
+} pool_slice_t;
+
+typedef struct pool_s pool_t;
+
+typedef struct{
+	pool_t * pool;
+	unsigned index;
+	pthread_t thread;
+} pool_worker_t;
+
+struct pool_s{
+	pool_slice_t * slice;
+	pool_worker_t * worker;
+	unsigned threads;
+	pool_task_t task;
+	void * ctx;
+};
+
+
+unsigned pool_cores( void ){
+
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+	return (n > 0) ? (unsigned)n : 1;
+}
+
+/**
+	@brief	Function takes one task from own slice.
+	@return	Return value is 1 when task was taken.
+*/
+static int pool_take( pool_slice_t * s, uint32_t * task ){
+
+	int ok = 0;
+
+	pthread_mutex_lock( &s->lock );
+	if( s->next < s->end ){
+		*task = s->next++;
+		ok = 1;
+	}
+	pthread_mutex_unlock( &s->lock );
+	return ok;
+}
+
+/**
+	@brief	Function moves upper half of the largest slice of other workers to own slice.
+	@return	Return value is 1 when something was stolen.
+*/
+static int pool_steal( pool_t * pool, unsigned me ){
+
+	pool_slice_t * own = &pool->slice[me];
+	unsigned i, victim = me;
+	uint32_t best = 0;
+
+	// Choose victim (size can change before it is split)...
+	for( i=0; i<pool->threads; i++ ){
+		pool_slice_t * s = &pool->slice[i];
+		uint32_t size = 0;
+		if( i == me ) continue;
+		pthread_mutex_lock( &s->lock );
+		if( s->next < s->end ) size = s->end - s->next;
+		pthread_mutex_unlock( &s->lock );
+		if( size > best ){
+			best = size;
+			victim = i;
+		}
+	}
+	if( victim == me ) return 0;
+
+	// ... and split its range under lock.
+	{
+		pool_slice_t * s = &pool->slice[victim];
+		uint32_t lo = 0, hi = 0;
+
+		pthread_mutex_lock( &s->lock );
+		if( s->next < s->end ){
+			hi = s->end;
+			lo = s->end - (s->end - s->next + 1) / 2;
+			s->end = lo;
+		}
+		pthread_mutex_unlock( &s->lock );
+		if( lo == hi ) return 1;		// Race lost, try again.
+
+		pthread_mutex_lock( &own->lock );
+		own->next = lo;
+		own->end = hi;
+		pthread_mutex_unlock( &own->lock );
+	}
+	return 1;
+}
+
+static void * pool_main( void * arg ){
+
+	pool_worker_t * w = arg;
+	pool_t * pool = w->pool;
+	uint32_t task;
+
+	for(;;){
+		if( pool_take( &pool->slice[w->index], &task ) ) pool->task( pool->ctx, w->index, task );
+		else if( !pool_steal( pool, w->index ) ) break;
+	}
+	return NULL;
+}
+
+int pool_run( unsigned threads, uint32_t nbr_of_tasks, pool_task_t task, void * ctx ){
+
+	pool_t pool;
+	unsigned i, started;
+	int err = 0;
+
+	if( threads == 0 ) threads = pool_cores();
+	if( threads > nbr_of_tasks ) threads = nbr_of_tasks ? nbr_of_tasks : 1;
+
+	pool.threads = threads;
+	pool.task = task;
+	pool.ctx = ctx;
+	pool.slice = calloc( threads, sizeof( pool_slice_t ) );
+	pool.worker = calloc( threads, sizeof( pool_worker_t ) );
+	if( pool.slice == NULL || pool.worker == NULL ){
+		free( pool.slice );
+		free( pool.worker );
+		return -1;
+	}
+
+	// Equal slices at start
+	for( i=0; i<threads; i++ ){
+		pthread_mutex_init( &pool.slice[i].lock, NULL );
+		pool.slice[i].next = (uint32_t)((uint64_t)nbr_of_tasks * i / threads);
+		pool.slice[i].end = (uint32_t)((uint64_t)nbr_of_tasks * (i+1) / threads);
+		pool.worker[i].pool = &pool;
+		pool.worker[i].index = i;
+	}
+
+	// Worker 0 is the calling thread.
+	for( started=1; started<threads; started++ ){
+		if( pthread_create( &pool.worker[started].thread, NULL, pool_main, &pool.worker[started] ) ){
+			err = -1;
+			break;
+		}
+	}
+	pool_main( &pool.worker[0] );
+	for( i=1; i<started; i++ ) pthread_join( pool.worker[i].thread, NULL );
+
+	for( i=0; i<threads; i++ ) pthread_mutex_destroy( &pool.slice[i].lock );
+	free( pool.slice );
+	free( pool.worker );
+	return err;
+}
@@ -0,0 +1,34 @@
+/**
+	@file	zumo_pool.h
+	@brief	Work-stealing thread pool for batch simulations (host build).
+	@details	Tasks are indices 0..n-1. Each worker starts with an equal slice and takes tasks from its bottom.
+						When the slice is empty, worker steals upper half of the largest remaining slice.
+*/
+#ifndef ZUMO_POOL_H_
+#define ZUMO_POOL_H_
+#include <stdint.h>
+
+/**
+	@brief	Task function.
+	@param	ctx User context.
+	@param	worker Index of worker thread (0..threads-1), e.g. for per-thread buffers.
+	@param	task Index of task.
+*/
+typedef void (*pool_task_t)( void * ctx, unsigned worker, uint32_t task );
+
+/**
+	@brief	Function returns number of online processors.
+*/
+unsigned pool_cores( void );
+
+/**
+	@brief	Function executes tasks 0..nbr_of_tasks-1 and returns when all of them are done.
+	@param	threads Number of worker threads (0 - one per core).
+	@param	nbr_of_tasks Number of tasks.
+	@param	task Task function.
+	@param	ctx User context passed to task function.
+	@return	Return value is 0 on success, -1 when threads could not be started.
+*/
+int pool_run( unsigned threads, uint32_t nbr_of_tasks, pool_task_t task, void * ctx );
+
+#endif
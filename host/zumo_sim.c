@@ -0,0 +1,458 @@
+/**
+	@file	zumo_sim.c
+	@brief	Deterministic kinematic simulator of Zumo on a line maze (host build).
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zumo_sim.h"
+#include "bluetooth.h"
+#include "motorDriver.h"
+#include "zumo_ledArray.h"
+#include "zumo_maze.h"
+#include "zumo_run.h"
+
+/**
+	@brief	Lateral position of each sensor, from left [mm] (positive - right side).
+*/
+static const float sim_sensor_lateral[ HAL_NBR_OF_SENSORS ] = { -35.0f, -19.0f, -6.0f, 6.0f, 19.0f, 35.0f };
+
+/**
+	@brief	Width of gray zone on tape edge [mm].
+*/
+#define SIM_EDGE_MM 3.0f
+
+/**
+	@brief	Length of finish marker side stripes [mm].
+*/
+#define SIM_FINISH_MM 60.0f
+
+
+void sim_clearMaze( sim_maze_t * maze ){
+
+	maze->nbr_of_segments = 0;
+	maze->nbr_of_entries = 0;
+	memset( maze->bucket, 0xff, sizeof( maze->bucket ) );
+	maze->start_x = 0;
+	maze->start_y = 0;
+	maze->start_heading = 0;
+	maze->finish_x = 0;
+	maze->finish_y = 0;
+	maze->has_finish = 0;
+}
+
+/**
+	@brief	Function returns hash bucket of bucket square (ix, iy).
+*/
+static uint32_t sim_bucketOf( int32_t ix, int32_t iy ){
+
+	return ((uint32_t)ix * 73856093u ^ (uint32_t)iy * 19349663u) & (SIM_BUCKETS - 1);
+}
+
+int sim_addSegment( sim_maze_t * maze, float x0, float y0, float x1, float y1 ){
+
+	sim_segment_t * s;
+	float margin = SIM_TAPE_MM / 2 + SIM_EDGE_MM;
+	int32_t ix, iy, ix0, iy0, ix1, iy1;
+
+	if( maze->nbr_of_segments >= SIM_MAX_SEGMENTS ) return -1;
+
+	// Bounding box of the tape with blurred edge
+	ix0 = (int32_t)floorf( (fminf( x0, x1 ) - margin) / SIM_BUCKET_MM );
+	ix1 = (int32_t)floorf( (fmaxf( x0, x1 ) + margin) / SIM_BUCKET_MM );
+	iy0 = (int32_t)floorf( (fminf( y0, y1 ) - margin) / SIM_BUCKET_MM );
+	iy1 = (int32_t)floorf( (fmaxf( y0, y1 ) + margin) / SIM_BUCKET_MM );
+	if( maze->nbr_of_entries + (uint32_t)((ix1 - ix0 + 1) * (iy1 - iy0 + 1)) > SIM_MAX_ENTRIES ) return -1;
+
+	for( iy=iy0; iy<=iy1; iy++ ){
+		for( ix=ix0; ix<=ix1; ix++ ){
+			uint32_t b = sim_bucketOf( ix, iy );
+			sim_entry_t * e = &maze->entry[ maze->nbr_of_entries ];
+			e->seg = maze->nbr_of_segments;
+			e->next = maze->bucket[b];
+			maze->bucket[b] = (int32_t)maze->nbr_of_entries++;
+		}
+	}
+
+	s = &maze->seg[ maze->nbr_of_segments++ ];
+	s->x0 = x0;
+	s->y0 = y0;
+	s->x1 = x1;
+	s->y1 = y1;
+	return 0;
+}
+
+int sim_addGridLink( sim_maze_t * maze, int col, int row, uint8_t south ){
+
+	float x = col * SIM_CELL_MM, y = -row * SIM_CELL_MM;
+	float e = SIM_TAPE_MM / 2;
+
+	// Extended by half of tape at both ends, so corners are fully covered.
+	if( south ) return sim_addSegment( maze, x, y + e, x, y - SIM_CELL_MM - e );
+	return sim_addSegment( maze, x - e, y, x + SIM_CELL_MM + e, y );
+}
+
+void sim_setGridStart( sim_maze_t * maze, int col, int row, uint8_t dir ){
+
+	maze->start_x = col * SIM_CELL_MM;
+	maze->start_y = -row * SIM_CELL_MM;
+	maze->start_heading = dir * (float)M_PI_2;
+}
+
+int sim_addGridFinish( sim_maze_t * maze, int col, int row, uint8_t dir ){
+
+	// Marker continues the line, so it is directed away from the only link.
+	return sim_addFinish( maze, col * SIM_CELL_MM, -row * SIM_CELL_MM, (dir ^ 2) * (float)M_PI_2 );
+}
+
+int sim_addFinish( sim_maze_t * maze, float x, float y, float heading ){
+
+	float fx = cosf( heading ), fy = sinf( heading );		// along the line
+	float rx = fy, ry = -fx;															// to the right
+	float side = -sim_sensor_lateral[0];									// stripes under outer sensors
+	float back = SIM_FINISH_MM * 2 / 3, front = SIM_FINISH_MM / 3;
+	int err = 0;
+
+	maze->finish_x = x;
+	maze->finish_y = y;
+	maze->has_finish = 1;
+
+	// Center line goes through the marker (25 mm wide, so sensors 2 and 3 are dark while 1 and 4 are white) ...
+	err |= sim_addSegment( maze, x - fx*back - rx*3, y - fy*back - ry*3, x + fx*front - rx*3, y + fy*front - ry*3 );
+	err |= sim_addSegment( maze, x - fx*back + rx*3, y - fy*back + ry*3, x + fx*front + rx*3, y + fy*front + ry*3 );
+	// ... and two side stripes make 101101 pattern.
+	err |= sim_addSegment( maze, x - fx*back - rx*side, y - fy*back - ry*side, x + fx*front - rx*side, y + fy*front - ry*side );
+	err |= sim_addSegment( maze, x - fx*back + rx*side, y - fy*back + ry*side, x + fx*front + rx*side, y + fy*front + ry*side );
+	return err;
+}
+
+/**
+	@brief	Function returns character at given grid position (space outside the grid).
+*/
+static char sim_gridAt( const char ** rows, const int * len, int nbr_of_rows, int r, int c ){
+
+	if( r < 0 || r >= nbr_of_rows || c < 0 || c >= len[r] ) return ' ';
+	return rows[r][c];
+}
+
+int sim_parseMaze( sim_maze_t * maze, const char * text ){
+
+	static const int dr[4] = { 0, -1, 0, 1 };		// east, north, west, south
+	static const int dc[4] = { 1, 0, -1, 0 };
+	const char * rows[ 1024 ];
+	int len[ 1024 ];
+	int nbr_of_rows = 0;
+	int starts = 0;
+	int r, c, d;
+	const char * p = text;
+
+	sim_clearMaze( maze );
+
+	// Split text into rows (comments are skipped)
+	while( *p != '\0' && nbr_of_rows < 1024 ){
+		const char * end = strchr( p, '\n' );
+		if( end == NULL ) end = p + strlen( p );
+		if( *p != '#' ){
+			rows[ nbr_of_rows ] = p;
+			len[ nbr_of_rows ] = (int)(end - p);
+			if( len[ nbr_of_rows ] > 0 && p[ len[nbr_of_rows]-1 ] == '\r' ) len[ nbr_of_rows ]--;
+			nbr_of_rows++;
+		}
+		p = (*end == '\0') ? end : end + 1;
+	}
+
+	for( r=0; r<nbr_of_rows; r += 2 ){
+		for( c=0; c<len[r]; c += 2 ){
+
+			char g = rows[r][c];
+			int links = 0, link_dir = 0;
+
+			if( g == ' ' ) continue;
+			if( g != '+' && g != 'S' && g != 'F' ) return -1;
+
+			for( d=0; d<4; d++ ){
+				char l = sim_gridAt( rows, len, nbr_of_rows, r + dr[d], c + dc[d] );
+				if( l == (dc[d] ? '-' : '|') ){
+					links++;
+					link_dir = d;
+					// Each connection is drawn once (east and south).
+					if( (d == 0 || d == 3) && sim_addGridLink( maze, c/2, r/2, d == 3 ) ) return -1;
+				}
+			}
+
+			if( g == 'S' ){
+				if( links != 1 ) return -1;
+				sim_setGridStart( maze, c/2, r/2, link_dir );
+				starts++;
+			}
+			else if( g == 'F' ){
+				if( links != 1 ) return -1;
+				if( sim_addGridFinish( maze, c/2, r/2, link_dir ) ) return -1;
+			}
+		}
+	}
+	return (starts == 1) ? 0 : -1;
+}
+
+int sim_loadMaze( sim_maze_t * maze, const char * path ){
+
+	FILE * f = fopen( path, "rb" );
+	char * text;
+	long size;
+	int err;
+
+	if( f == NULL ) return -1;
+	fseek( f, 0, SEEK_END );
+	size = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	text = malloc( size + 1 );
+	if( text == NULL || fread( text, 1, size, f ) != (size_t)size ){
+		free( text );
+		fclose( f );
+		return -1;
+	}
+	text[size] = '\0';
+	fclose( f );
+
+	err = sim_parseMaze( maze, text );
+	free( text );
+	return err;
+}
+
+
+/**
+	@brief	Function returns how much of tape is under the point (0 - white, 1 - black).
+*/
+static float sim_darkness( const sim_maze_t * maze, float x, float y ){
+
+	float best = 0;
+	int32_t i;
+
+	i = maze->bucket[ sim_bucketOf( (int32_t)floorf( x / SIM_BUCKET_MM ), (int32_t)floorf( y / SIM_BUCKET_MM ) ) ];
+	for( ; i >= 0; i = maze->entry[i].next ){
+
+		const sim_segment_t * s = &maze->seg[ maze->entry[i].seg ];
+		float dx = s->x1 - s->x0, dy = s->y1 - s->y0;
+		float length = sqrtf( dx*dx + dy*dy );
+		float along, across, outside, f;
+
+		if( length <= 0 ) continue;
+		dx /= length;
+		dy /= length;
+		along = (x - s->x0)*dx + (y - s->y0)*dy;
+		across = fabsf( (x - s->x0)*dy - (y - s->y0)*dx );
+
+		// Rectangular tape, blurred on the edges.
+		outside = across - SIM_TAPE_MM / 2;
+		if( -along > outside ) outside = -along;
+		if( along - length > outside ) outside = along - length;
+
+		f = 0.5f - outside / SIM_EDGE_MM;
+		if( f > best ) best = f;
+		if( best >= 1 ) return 1;
+	}
+	return (best < 0) ? 0 : best;
+}
+
+static uint32_t sim_rand( sim_robot_t * robot ){
+
+	robot->rng = robot->rng * 1664525u + 1013904223u;
+	return robot->rng >> 8;
+}
+
+/**
+	@brief	Host HAL callback - discharge time of each sensor.
+*/
+static uint32_t sim_sample( void * ctx, uint16_t * raw, uint16_t timeout ){
+
+	sim_robot_t * robot = ctx;
+	float fx = cosf( robot->heading ), fy = sinf( robot->heading );
+	float cx = robot->x + fx * SIM_SENSOR_OFFSET_MM;
+	float cy = robot->y + fy * SIM_SENSOR_OFFSET_MM;
+	uint16_t longest = 0;
+	uint8_t i;
+
+	for( i=0; i<HAL_NBR_OF_SENSORS; i++ ){
+
+		// Right side of the robot is (fy, -fx).
+		float sx = cx + fy * sim_sensor_lateral[i];
+		float sy = cy - fx * sim_sensor_lateral[i];
+		float dark = sim_darkness( robot->maze, sx, sy );
+
+		raw[i] = SIM_RAW_WHITE + (uint16_t)(dark * (SIM_RAW_BLACK - SIM_RAW_WHITE)) + (sim_rand( robot ) % SIM_RAW_NOISE);
+#if LA_SAMPLING_POLL
+		// Discharge is seen at the next sample.
+		raw[i] = (uint16_t)(((uint32_t)raw[i] + LA_POLL_PERIOD - 1) / LA_POLL_PERIOD * LA_POLL_PERIOD);
+#endif
+		if( raw[i] > timeout ) raw[i] = timeout;
+		if( raw[i] > longest ) longest = raw[i];
+	}
+
+	// Frame lasts until the darkest sensor is discharged or timeout (plus capacitor charging).
+	return (uint32_t)((longest + LA_DELAY_CAP_DISCHARGE) * SIM_TICK_US);
+}
+
+/**
+	@brief	Host HAL callback - differential drive kinematics.
+*/
+static void sim_advance( void * ctx, uint32_t dt_us ){
+
+	sim_robot_t * robot = ctx;
+
+	while( dt_us > 0 ){
+
+		uint32_t step = (dt_us > SIM_STEP_US) ? SIM_STEP_US : dt_us;
+		float dt = step * 1e-6f;
+		float k = step / (SIM_MOTOR_TAU_US + step);
+		float target_left = SIM_VMAX_MM_S * hal_host_getMotor( HAL_MOTOR_LEFT ) / HAL_PWM_MOD;
+		float target_right = SIM_VMAX_MM_S * hal_host_getMotor( HAL_MOTOR_RIGHT ) / HAL_PWM_MOD;
+		float v, w;
+
+		// Motors follow PWM with first order lag.
+		robot->v_left += (target_left - robot->v_left) * k;
+		robot->v_right += (target_right - robot->v_right) * k;
+
+		v = (robot->v_left + robot->v_right) / 2;
+		w = (robot->v_right - robot->v_left) / SIM_TRACK_MM;
+
+		robot->x += v * cosf( robot->heading + w*dt/2 ) * dt;
+		robot->y += v * sinf( robot->heading + w*dt/2 ) * dt;
+		robot->heading += w * dt;
+
+		robot->time_us += step;
+		dt_us -= step;
+	}
+
+	if( robot->abort != NULL && robot->time_us > robot->limit_us ) longjmp( *robot->abort, 1 );
+}
+
+void sim_placeAtStart( sim_robot_t * robot ){
+
+	robot->x = robot->maze->start_x;
+	robot->y = robot->maze->start_y;
+	robot->heading = robot->maze->start_heading;
+	robot->v_left = 0;
+	robot->v_right = 0;
+}
+
+void sim_attach( sim_robot_t * robot, const sim_maze_t * maze, uint32_t seed ){
+
+	robot->maze = maze;
+	sim_placeAtStart( robot );
+	robot->time_us = 0;
+	robot->limit_us = UINT64_MAX;
+	robot->rng = seed;
+	robot->abort = NULL;
+
+	robot->world.ctx = robot;
+	robot->world.sample = sim_sample;
+	robot->world.advance = sim_advance;
+	hal_host_attach( &robot->world );
+}
+
+int sim_parsePolicy( const char * name ){
+
+	int p;
+
+	for( p=0; p<MP_NBR_OF_POLICIES; p++ ){
+		if( strcmp( name, mp_policyName( p ) ) == 0 ) return p;
+		if( name[0] == ZR_POLICY_COMMANDS[p] && name[1] == '\0' ) return p;
+	}
+	return -1;
+}
+
+int sim_goalCells( const sim_maze_t * maze, int16_t * forward, int16_t * left ){
+
+	float dx = maze->finish_x - maze->start_x, dy = maze->finish_y - maze->start_y;
+	float c = cosf( maze->start_heading ), s = sinf( maze->start_heading );
+
+	if( !maze->has_finish ) return -1;
+	*forward = (int16_t)lroundf( (dx*c + dy*s) / SIM_CELL_MM );
+	*left = (int16_t)lroundf( (dy*c - dx*s) / SIM_CELL_MM );
+	return 0;
+}
+
+int sim_run( const sim_maze_t * maze, mp_policy_t policy, uint32_t seed, uint64_t limit_us, FILE * telemetry, sim_result_t * result ){
+
+	sim_robot_t robot;
+	jmp_buf abort;
+	uint64_t t;
+	uint32_t frame;
+	int16_t forward, left;
+
+	memset( result, 0, sizeof( *result ) );
+
+	sim_attach( &robot, maze, seed );
+	hal_host_setUartSink( telemetry );
+
+	// The same initialization as in main.c
+	hal_clockInit();
+	bt_init( BAUD_RATE );
+	motorDriverInit();
+	la_init();
+
+	robot.limit_us = limit_us;
+	robot.abort = &abort;
+	if( setjmp( abort ) != 0 ){
+		hal_host_attach( NULL );
+		result->total_us = robot.time_us;
+		return -1;
+	}
+
+	// Route saved in flash before reset goes straight to replay (see hal_host_setFlashFile).
+	if( zr_loadRecord() ){
+		t = hal_host_micros();
+		frame = la_peekFrameNumber();
+		result->replay_nodes = zr_replay( ZR_REPLAY_SPEED, &zumoRecord.fingerprint );
+		if( result->replay_nodes != 0 ){
+			result->replay_us = hal_host_micros() - t;
+			result->replay_frames = la_peekFrameNumber() - frame;
+			result->explored = 1;
+			result->finished = 1;
+			result->stored = 1;
+			result->total_us = robot.time_us;
+			hal_host_attach( NULL );
+			return 0;
+		}
+		// Other maze - operator puts Zumo back on start and the whole sequence is done.
+		result->replay_nodes = 0;
+		sim_placeAtStart( &robot );
+	}
+
+	zm_calibration( ZR_CALIBRATION_SPEED );
+
+	// Operator selects policy and gives position of finish.
+	if( policy == MP_FLOOD_FILL && sim_goalCells( maze, &forward, &left ) == 0 ) zr_setGoal( forward, left );
+	zr_selectPolicy( policy );
+
+	t = hal_host_micros();
+	frame = la_peekFrameNumber();
+	result->explore_nodes = zr_explore( ZR_EXPLORE_SPEED );
+	result->explore_us = hal_host_micros() - t;
+	result->explore_frames = la_peekFrameNumber() - frame;
+	if( result->explore_nodes == 0 ){
+		result->map_full = 1;
+		result->total_us = robot.time_us;
+		hal_host_attach( NULL );
+		return -1;
+	}
+	result->explored = 1;
+
+	zr_optimize();
+
+	// Operator puts Zumo back on start.
+	sim_placeAtStart( &robot );
+
+	t = hal_host_micros();
+	frame = la_peekFrameNumber();
+	result->replay_nodes = zr_replay( ZR_REPLAY_SPEED, NULL );
+	result->replay_us = hal_host_micros() - t;
+	result->replay_frames = la_peekFrameNumber() - frame;
+	result->finished = result->replay_nodes != 0;
+	if( result->finished ) zr_saveRecord();
+
+	result->total_us = robot.time_us;
+	hal_host_attach( NULL );
+	return result->finished ? 0 : -1;
+}
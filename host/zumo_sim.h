@@ -0,0 +1,249 @@
+/**
+	@file	zumo_sim.h
+	@brief	Deterministic kinematic simulator of Zumo on a line maze (host build).
+	@details	Maze is a set of line segments (black tape on white board). Robot is a differential drive with
+						reflectance array of six sensors (from left, like PTA4, PTC1, PTD6, PTC2, PTD3, PTA5 in zumo_ledArray.h).
+						Simulator is attached to host HAL backend, so the real solver code (zumo_maze.c) drives it with virtual clock.
+						Units: millimetres, radians, microseconds.
+*/
+#ifndef ZUMO_SIM_H_
+#define ZUMO_SIM_H_
+#include <stdint.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include "zumo_hal_host.h"
+#include "zumo_map.h"
+#include "zumo_ledArray.h"
+
+/**
+	@brief	Maximum number of tape segments in one maze.
+*/
+#define SIM_MAX_SEGMENTS 8192
+
+/**
+	@brief	Spatial index of segments: number of hash buckets (power of two), side of bucket square [mm]
+					and maximum number of (bucket, segment) entries.
+*/
+#define SIM_BUCKETS 4096
+#define SIM_BUCKET_MM 150.0f
+#define SIM_MAX_ENTRIES ( 6 * SIM_MAX_SEGMENTS )
+
+/**
+	@brief	Distance between adjacent grid points in mazes built from grid [mm].
+*/
+#define SIM_CELL_MM 150.0f
+
+/**
+	@brief	Width of black tape [mm].
+*/
+#define SIM_TAPE_MM 19.0f
+
+/**
+	@brief	Distance between wheels (track) [mm].
+*/
+#define SIM_TRACK_MM 86.0f
+
+/**
+	@brief	Distance from wheel axis to reflectance array [mm].
+*/
+#define SIM_SENSOR_OFFSET_MM 40.0f
+
+/**
+	@brief	Track speed at full PWM duty (::HAL_PWM_MOD) [mm/s].
+*/
+#define SIM_VMAX_MM_S 500.0f
+
+/**
+	@brief	Time constant of motor response [us].
+*/
+#define SIM_MOTOR_TAU_US 20000.0f
+
+/**
+	@brief	Longest step of kinematic integration [us].
+*/
+#define SIM_STEP_US 250
+
+/**
+	@brief	Discharge time over white board and over black tape, and range of noise [timer ticks] (10, 80 and 3 LPTMR ticks).
+*/
+#define SIM_RAW_WHITE ((10 * LA_TIMER_HZ + 16384) / 32768)
+#define SIM_RAW_BLACK ((80 * LA_TIMER_HZ + 16384) / 32768)
+#define SIM_RAW_NOISE ((3 * LA_TIMER_HZ + 16384) / 32768)
+
+/**
+	@brief	Duration of one timer tick (::LA_TIMER_HZ) [us].
+*/
+#define SIM_TICK_US (1e6f / LA_TIMER_HZ)
+
+/**
+	@brief	One black tape segment.
+*/
+typedef struct{
+	float x0, y0;		/**< Start point */
+	float x1, y1;		/**< End point */
+} sim_segment_t;
+
+/**
+	@brief	Entry of spatial index - segment which may cover part of the bucket.
+*/
+typedef struct{
+	uint16_t seg;							/**< Index of segment */
+	int32_t next;							/**< Next entry in the same bucket (-1 - last) */
+} sim_entry_t;
+
+/**
+	@brief	Maze rendered as line segments.
+	@details	Each segment is also linked into all hash buckets its tape touches, so sensor reading checks only a few
+						segments close to the sensor, whatever the size of maze is.
+*/
+typedef struct{
+	sim_segment_t seg[ SIM_MAX_SEGMENTS ];		/**< Tape segments */
+	uint16_t nbr_of_segments;									/**< Number of used segments */
+	int32_t bucket[ SIM_BUCKETS ];						/**< First entry of each bucket (-1 - empty) */
+	sim_entry_t entry[ SIM_MAX_ENTRIES ];			/**< Spatial index entries */
+	uint32_t nbr_of_entries;									/**< Number of used entries */
+	float start_x, start_y;										/**< Start position of wheel axis */
+	float start_heading;											/**< Start heading (0 - east, counter-clockwise) */
+	float finish_x, finish_y;									/**< Finish marker position */
+	uint8_t has_finish;												/**< 1 - finish marker was added */
+} sim_maze_t;
+
+/**
+	@brief	State of simulated robot.
+*/
+typedef struct{
+	const sim_maze_t * maze;		/**< Maze under the robot */
+	float x, y, heading;				/**< Pose of wheel axis centre */
+	float v_left, v_right;			/**< Current track speed [mm/s] */
+	uint64_t time_us;						/**< Simulated time */
+	uint64_t limit_us;					/**< Time after which run is aborted */
+	uint32_t rng;								/**< Noise generator state */
+	jmp_buf * abort;						/**< Where to jump when time limit is exceeded */
+	hal_host_world_t world;			/**< Callbacks for host HAL backend */
+} sim_robot_t;
+
+/**
+	@brief	Result of one full run (calibration, exploration, optimization, replay).
+*/
+typedef struct{
+	uint8_t finished;						/**< 1 - 'F' reaction reached in replay phase */
+	uint8_t explored;						/**< 1 - 'F' reaction reached in exploration phase */
+	uint8_t stored;							/**< 1 - route saved in flash was replayed, exploration was skipped */
+	uint8_t map_full;						/**< 1 - exploration was stopped, because the maze did not fit in the map (or route in its buffer) */
+	uint16_t explore_nodes;			/**< Nodes visited during exploration */
+	uint16_t replay_nodes;			/**< Nodes visited during replay */
+	uint64_t explore_us;				/**< Exploration time (virtual) */
+	uint64_t replay_us;					/**< Replay time (virtual) */
+	uint32_t explore_frames;		/**< Sensor frames completed during exploration */
+	uint32_t replay_frames;			/**< Sensor frames completed during replay */
+	uint64_t total_us;					/**< Time of whole run including calibration (virtual) */
+} sim_result_t;
+
+
+/**
+	@brief	Function clears maze.
+	@param	maze Pointer to maze
+*/
+void sim_clearMaze( sim_maze_t * maze );
+
+/**
+	@brief	Function adds one tape segment.
+	@return	Return value is 0 on success, -1 when maze is full.
+*/
+int sim_addSegment( sim_maze_t * maze, float x0, float y0, float x1, float y1 );
+
+/**
+	@brief	Function adds tape between grid point and its east or south neighbour (see ::sim_parseMaze).
+	@param	col,row Grid point (row grows southward).
+	@param	south 0 - link to east neighbour, 1 - link to south neighbour.
+	@return	Return value is 0 on success, -1 when maze is full.
+*/
+int sim_addGridLink( sim_maze_t * maze, int col, int row, uint8_t south );
+
+/**
+	@brief	Function sets start at grid point.
+	@param	col,row Grid point.
+	@param	dir Direction of its only link: 0 - east, 1 - north, 2 - west, 3 - south.
+*/
+void sim_setGridStart( sim_maze_t * maze, int col, int row, uint8_t dir );
+
+/**
+	@brief	Function adds finish marker after grid point.
+	@param	col,row Grid point.
+	@param	dir Direction of its only link: 0 - east, 1 - north, 2 - west, 3 - south.
+	@return	Return value is 0 on success, -1 when maze is full.
+*/
+int sim_addGridFinish( sim_maze_t * maze, int col, int row, uint8_t dir );
+
+/**
+	@brief	Function adds finish marker (101101) at the end of a line.
+	@param	x,y	End of line.
+	@param	heading Direction of line at the end.
+	@return	Return value is 0 on success, -1 when maze is full.
+*/
+int sim_addFinish( sim_maze_t * maze, float x, float y, float heading );
+
+/**
+	@brief	Function builds maze from text grid.
+	@details	Grid points are on even rows and columns, connections between them on odd ones:
+						<ul>
+							<li> '+' - grid point with tape
+							<li> 'S' - start point (exactly one connection)
+							<li> 'F' - finish point, marker is placed after it (exactly one connection)
+							<li> '-' and '|' - horizontal and vertical connection
+							<li> lines starting with '#' are comments
+						</ul>
+	@param	text Zero-terminated grid.
+	@return	Return value is 0 on success, -1 on syntax error.
+*/
+int sim_parseMaze( sim_maze_t * maze, const char * text );
+
+/**
+	@brief	Function reads text grid from file (see ::sim_parseMaze).
+	@return	Return value is 0 on success, -1 on error.
+*/
+int sim_loadMaze( sim_maze_t * maze, const char * path );
+
+/**
+	@brief	Function places robot at the maze start and attaches it to host HAL backend.
+	@param	robot Pointer to robot state.
+	@param	maze Pointer to maze.
+	@param	seed Seed of sensor noise.
+*/
+void sim_attach( sim_robot_t * robot, const sim_maze_t * maze, uint32_t seed );
+
+/**
+	@brief	Function puts robot (standing still) at the maze start, like operator does before each phase.
+	@param	robot Pointer to attached robot state.
+*/
+void sim_placeAtStart( sim_robot_t * robot );
+
+/**
+	@brief	Function finds exploration policy by its name (::mp_policyName) or Bluetooth command (::ZR_POLICY_COMMANDS).
+	@return	Return value is the policy or -1 when it is not known.
+*/
+int sim_parsePolicy( const char * name );
+
+/**
+	@brief	Function finds finish position relative to start, as operator gives it for ::MP_FLOOD_FILL policy.
+	@param[out]	forward,left Grid cells from start to finish in start direction and to the left of it.
+	@return	Return value is 0 on success, -1 when maze has no finish.
+*/
+int sim_goalCells( const sim_maze_t * maze, int16_t * forward, int16_t * left );
+
+/**
+	@brief	Function runs whole sequence from main.c (calibration, exploration, optimization, replay) on simulated robot.
+	@details	Exploration policy is selected before exploration, like with button or Bluetooth command. ::MP_FLOOD_FILL gets goal from ::sim_goalCells.
+						Record flash (::hal_host_setFlashFile) is used like on the board: matching saved route is replayed at once
+						and route is saved after replay.
+	@param	maze Pointer to maze.
+	@param	policy Exploration policy.
+	@param	seed Seed of sensor noise.
+	@param	limit_us Virtual time after which run is aborted.
+	@param	telemetry Stream for Bluetooth telemetry (NULL - discard).
+	@param[out]	result Run statistics.
+	@return	Return value is 0 when run finished, -1 when it was aborted, exploration was stopped (::sim_result_t map_full) or replay was stopped.
+*/
+int sim_run( const sim_maze_t * maze, mp_policy_t policy, uint32_t seed, uint64_t limit_us, FILE * telemetry, sim_result_t * result );
+
+#endif
@@ -0,0 +1,93 @@
+/**
+	@file	zumo_sim_main.c
+	@brief	Runs Zumo maze solver on simulated maze (host build).
+	@details	Usage: zumo_sim [-v] [-p policy] [-f flash.bin] [-s seed] [-t limit_s] maze.txt | -c corpus.bin index
+						<ul>
+							<li> -v - print Bluetooth telemetry
+							<li> -p - exploration policy: left-hand, right-hand, tremaux (default), flood-fill or its command letter (L, R, T, F)
+							<li> -f - file with record flash sector kept between runs (saved route is replayed when it fits the maze)
+							<li> -s - seed of sensor noise
+							<li> -t - virtual time limit in seconds
+							<li> -c - take maze with given index from corpus made by zumo_mazegen
+						</ul>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "zumo_corpus.h"
+#include "zumo_sim.h"
+
+static sim_maze_t maze;
+
+int main( int argc, char * argv[] ){
+
+	FILE * telemetry = NULL;
+	uint32_t seed = 1;
+	uint64_t limit_us = 600ull * 1000000;
+	const char * path = NULL;
+	const char * corpus_path = NULL;
+	const char * flash_path = NULL;
+	sim_result_t result;
+	struct timespec t0, t1;
+	double wall;
+	int i, err, policy = MP_TREMAUX;
+
+	for( i=1; i<argc; i++ ){
+		if( strcmp( argv[i], "-v" ) == 0 ) telemetry = stdout;
+		else if( strcmp( argv[i], "-p" ) == 0 && i+1 < argc ){
+			policy = sim_parsePolicy( argv[++i] );
+			if( policy < 0 ){
+				fprintf( stderr, "%s: unknown policy\n", argv[i] );
+				return 2;
+			}
+		}
+		else if( strcmp( argv[i], "-s" ) == 0 && i+1 < argc ) seed = strtoul( argv[++i], NULL, 10 );
+		else if( strcmp( argv[i], "-t" ) == 0 && i+1 < argc ) limit_us = strtoull( argv[++i], NULL, 10 ) * 1000000;
+		else if( strcmp( argv[i], "-c" ) == 0 && i+1 < argc ) corpus_path = argv[++i];
+		else if( strcmp( argv[i], "-f" ) == 0 && i+1 < argc ) flash_path = argv[++i];
+		else path = argv[i];
+	}
+	if( path == NULL ){
+		fprintf( stderr, "usage: %s [-v] [-p policy] [-f flash.bin] [-s seed] [-t limit_s] maze.txt | -c corpus.bin index\n", argv[0] );
+		return 2;
+	}
+	if( corpus_path != NULL ){
+		corpus_t corpus;
+		const corpus_maze_t * m;
+
+		if( corpus_open( &corpus, corpus_path ) ){
+			fprintf( stderr, "%s: invalid corpus\n", corpus_path );
+			return 2;
+		}
+		m = corpus_get( &corpus, strtoul( path, NULL, 10 ) );
+		if( m == NULL || corpus_render( m, &maze ) ){
+			fprintf( stderr, "%s: no maze %s\n", corpus_path, path );
+			return 2;
+		}
+		if( telemetry != NULL ) corpus_print( m, stdout );
+		corpus_close( &corpus );
+	}
+	else if( sim_loadMaze( &maze, path ) ){
+		fprintf( stderr, "%s: invalid maze\n", path );
+		return 2;
+	}
+
+	if( hal_host_setFlashFile( flash_path ) ){
+		fprintf( stderr, "%s: invalid flash file\n", flash_path );
+		return 2;
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &t0 );
+	err = sim_run( &maze, policy, seed, limit_us, telemetry, &result );
+	clock_gettime( CLOCK_MONOTONIC, &t1 );
+	wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	printf( "%s: %s\n", path, err ? (result.map_full ? "MAP FULL" : "ABORTED") : "finished" );
+	printf( "  exploration  %8.3f s  %4u nodes\n", result.explore_us * 1e-6, result.explore_nodes );
+	printf( "  replay       %8.3f s  %4u nodes%s\n", result.replay_us * 1e-6, result.replay_nodes, result.stored ? " (saved route)" : "" );
+	printf( "  virtual time %8.3f s, wall time %.3f ms (%.0fx real time)\n",
+					result.total_us * 1e-6, wall * 1e3, result.total_us * 1e-6 / wall );
+	return err ? 1 : 0;
+}
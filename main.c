@@ -10,40 +10,10 @@
 #include "motorDriver.h"
 #include "zumo_button.h"
 #include "zumo_buzzer.h"
+#include "zumo_hal.h"
 #include "zumo_ledArray.h"
 #include "zumo_maze.h"
-
-
-/**
-	@brief	Function sends via Bluetooth (UART2) state of LED sensor. '1' means black.
-	@param	state Binary coded sensor state.
-*/
-void sendArrayState( char state ){
-	int8_t i;
-	
-	for( i=5; i>=0; i--){
-		bt_sendChar( (state & (1<<i)) ? '1' : '0' );
-	}
-	bt_sendChar( '\r' );
-	bt_sendChar( '\n' );
-}
-
-/**
-	@brief	Function sends via Bluetooth (UART2) command set.
-	@param	route Pointer to string.
-	@warning	Input string has to be ended with a '\0' (NULL) character.
-*/
-void sendRoute( char * route ){
-	
-	while( *route != '\0' ){
-		bt_sendChar( *route );
-		route++;
-	}
-	bt_sendChar( '\r' );
-}
-
-
-
+#include "zumo_run.h"
 
 
 /*
@@ -60,6 +30,31 @@ enum Node_type{
 */
 
 
+/**
+	@brief	Function waits for button press and counts presses which follow it in one series.
+	@details	Bluetooth commands are executed while waiting (::zr_readCommand). Series ends 1 s after the last release.
+	@return	Return value is number of presses.
+*/
+static uint8_t countPresses( void ){
+	
+	uint8_t presses = 0;
+	uint32_t released;
+	
+	while( !zumo_button_pressed() ) zr_readCommand();
+	do{
+		presses++;
+		// Debounce both edges
+		_delay_ms( 50 );
+		while( zumo_button_pressed() );
+		_delay_ms( 50 );
+		released = hal_millis();
+		while( !zumo_button_pressed() && hal_millis() - released < 1000 );
+	}while( zumo_button_pressed() );
+	
+	return presses;
+}
+
+
 /**
 	@brief	Zumo maze solver main function.
 	@details	This function is built from three parts: calibration, solving the maze, driving to end by orders. 
@@ -67,10 +62,11 @@ enum Node_type{
 */
 int main(void){
 	
-	uint8_t node_type;
-	char reaction;
+	uint8_t presses;
 	
 	// Initialize everything
+	hal_stackPaint();
+	hal_clockInit();
 	zumo_button_init();
 	ledsInitialize();
 	zumo_buzzer_init();
@@ -78,14 +74,31 @@ int main(void){
 	motorDriverInit();
 	la_init();
 	
-	bt_sendStr("\rZumo Maze solver gotowy\rAby skalibrowac nacisnij przycisk...\r");
+	bt_sendStr("\rZumo Maze solver gotowy\r");
+	
+	// Route saved before reset: calibration is restored, so go straight to phase 3.
+	if( zr_loadRecord() ){
+		ledGreenOn();
+		bt_sendStr("Faza 3: Przejazd wg zapisanych rozkazow\rAby kontynuowac nacisnij przycisk...\r");
+		while( !zumo_button_pressed() );
+		_delay_ms( 1000 );
+		
+		// Zumo stops in the first node when the maze is different.
+		if( zr_replay( ZR_REPLAY_SPEED, &zumoRecord.fingerprint ) ){
+			bt_sendStr("\rDojechalem!\r\r");
+			zb_doubleBeep();
+		}
+		bt_sendStr("Postaw Zumo na starcie\r");
+	}
+	
+	bt_sendStr("Aby skalibrowac nacisnij przycisk...\r");
 	// Wait for user reaction
 	while( !zumo_button_pressed() );
 	_delay_ms( 1000 );
 
 	bt_sendStr("Kalibruje...\r");
 	// Calibrate itself
-	zm_calibration( 30 );
+	zm_calibration( ZR_CALIBRATION_SPEED );
 
 	bt_sendStr("Kalibracja zakonczona\r");
 	
@@ -96,30 +109,14 @@ int main(void){
 		ledGreenOff();
 		
 		bt_sendStr("Faza 1: Rozpoznanie trasy\rAby kontynuowac nacisnij przycisk...\r");
+		bt_sendStr("Strategia: 2x - lewa reka, 3x - prawa reka, 4x - Tremaux, 5x - do celu (lub komenda L, R, T, F x y)\r");
 		
-		// Wait for user reaction
-		while( !zumo_button_pressed() );
-		_delay_ms( 1000 );
+		// Wait for user reaction. One press keeps exploration policy, series of presses selects another one.
+		presses = countPresses();
+		if( presses >= 2 && presses < 2 + MP_NBR_OF_POLICIES ) zr_selectPolicy( (mp_policy_t)(presses - 2) );
 		
-		// Prepare both arrays for incoming data
-		zm_clearArray( &nodeArr );
-		zm_clearArray( &optimizedNodeArr );
-		
-		// Get to the end of the maze
-		do{		
-			zm_driveToNode( 45 );
-			sendArrayState( la_getSensorState() );
-			
-			node_type =  zm_checkNode( 45 );
-			sendArrayState( la_getSensorState() );
-			bt_sendChar( node_type );
-			bt_sendChar( '\r' );
-						
-			reaction = zm_nodeReaction( node_type, 45 );
-			bt_sendChar( reaction );
-			bt_sendChar( '\r' );
-			
-		}while( reaction != 'F' );
+		// Get to the end of the maze. Too big maze ends phase 1 without finish.
+		if( zr_explore( ZR_EXPLORE_SPEED ) == 0 ) continue;
 		
 		// Play some sound
 		zb_doubleBeep();
@@ -127,15 +124,7 @@ int main(void){
 		
 		bt_sendStr("\r\rFaza 2: Optymalizacja trasy\r");
 		// Optimize route	
-		zm_routeOptimizer( nodeArr.tab , optimizedNodeArr.tab );
-		bt_sendChar( '\r' );
-		bt_sendChar( '\r' );
-		bt_sendStr("Stara trasa\r");
-		sendRoute( nodeArr.tab );
-		bt_sendStr("\rNowa trasa\r");
-		sendRoute( optimizedNodeArr.tab );
-		bt_sendChar( '\r' );
-		bt_sendChar( '\r' );
+		zr_optimize();
 		
 		// Turn off orange diode on Zumo. Zumo knows where is end.
 		ledGreenOn();
@@ -145,23 +134,16 @@ int main(void){
 		while( !zumo_button_pressed() );
 		_delay_ms( 1000 );
 			
-		// Get to the end without mistakes
-		do{
-			zm_driveToNode( 35 );
-			sendArrayState( la_getSensorState() );
-			
-			node_type = zm_checkNode( 35 );
-			sendArrayState( la_getSensorState() );
-			bt_sendChar( node_type );
-			bt_sendChar( '\r' );
-						
-			reaction = zm_strictNodeReaction( &optimizedNodeArr, node_type, 35);
-			bt_sendChar( reaction );
-			bt_sendChar( '\r' );
-			
-		}while( reaction != 'F' );
+		// Get to the end without mistakes. Zumo stops when node does not fit the route (e.g. maze was changed).
+		if( zr_replay( ZR_REPLAY_SPEED, NULL ) == 0 ) continue;
 		
 		bt_sendStr("\rDojechalem!\r\r");
+		// The deepest stack use so far, control tick and sensor interrupts included (Stack_Size in startup_MKL46Z4.s)
+		bt_sendStr("Stos: ");
+		zr_sendNumber( hal_stackUsed() );
+		bt_sendStr(" B\r");
+		// Keep route and calibration for the next power-on
+		bt_sendStr( zr_saveRecord() ? "Trasa zapisana\r" : "Blad zapisu trasy\r" );
 		// Play some sound
 		zb_doubleBeep();
 	}
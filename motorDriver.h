@@ -1,7 +1,7 @@
 #ifndef MOTORDRIVER_H_
 #define MOTORDRIVER_H_
 
-#include "MKL46Z4.h"
+#include <stdint.h>
 
 // initialize motor driver
 void motorDriverInit(void);
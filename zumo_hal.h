@@ -0,0 +1,170 @@
+/**
+	@file	zumo_hal.h
+	@brief	Hardware abstraction layer for Zumo maze solver.
+	@details	Solver and driver libraries (zumo_maze.c, motorDriver.c, zumo_ledArray.c, bluetooth.c) are written against this interface only.
+						Available backends:
+						<ul>
+							<li> zumo_hal_kl46z.c - Freescale KL46Z board and Pololu Zumo Shield (Keil project)
+							<li> host/zumo_hal_host.c - x86-64 Linux process (host/Makefile)
+						</ul>
+*/
+#ifndef ZUMO_HAL_H_
+#define ZUMO_HAL_H_
+#include <stdint.h>
+
+/**
+	@brief	Number of reflectance sensors in one frame.
+*/
+#define HAL_NBR_OF_SENSORS 6
+
+/**
+	@brief	PWM period (modulo). Motor duty is given in range 0 - HAL_PWM_MOD.
+*/
+#define HAL_PWM_MOD 1023
+
+/**
+	@brief	Size of flash sector for saved records [bytes]. Data is programmed in 4-byte words.
+*/
+#define HAL_FLASH_SECTOR_SIZE 1024
+
+/**
+	@brief	Storage class of solver and driver state (global variables).
+	@details	Host build runs many solvers in parallel threads, so there each thread has its own copy.
+*/
+#ifdef ZUMO_HOST
+#define HAL_STATE _Thread_local
+#else
+#define HAL_STATE
+#endif
+
+/**
+	@brief	Motor selection for ::hal_motorWrite
+*/
+typedef enum{
+	HAL_MOTOR_LEFT,			/**< Left track */
+	HAL_MOTOR_RIGHT			/**< Right track */
+} hal_motor_t;
+
+
+// Sensor frame source
+/**
+	@brief	Function starts reflectance sensor measurement cycle.
+	@details	Every complete frame (discharge time of each sensor) is passed to ::la_frameComplete.
+*/
+void hal_sensorInit(void);
+
+/**
+	@brief	Function synchronises the caller with the frame source.
+	@details	KL46Z: frames are produced by interrupts, so it returns immediately.
+						Host: it produces next frame and moves virtual clock forward.
+*/
+void hal_sensorSync(void);
+
+
+// Motor sink
+/**
+	@brief	Function prepares PWM and direction pins of both motors.
+*/
+void hal_motorInit(void);
+
+/**
+	@brief	Function sets direction and duty of one motor.
+	@param	motor Selected motor.
+	@param	reverse 0 - forward, 1 - reverse.
+	@param	duty PWM duty in range 0 - ::HAL_PWM_MOD.
+*/
+void hal_motorWrite( hal_motor_t motor, uint8_t reverse, uint16_t duty );
+
+
+// UART byte sink
+/**
+	@brief	Function prepares serial port. UART module is selected in bluetooth.h (::UART_MODULE).
+	@param	baud_rate Speed of transmission.
+*/
+void hal_uartInit( uint32_t baud_rate );
+
+/**
+	@brief	Function starts transmission of ::TxBuf if transmitter is idle.
+*/
+void hal_uartKick(void);
+
+
+// Millisecond clock
+/**
+	@brief	Function starts millisecond clock.
+*/
+void hal_clockInit(void);
+
+/**
+	@brief	Function returns time since ::hal_clockInit.
+	@return	Return value is time in milliseconds.
+*/
+uint32_t hal_millis(void);
+
+/**
+	@brief	Function returns time since ::hal_clockInit with microsecond resolution (it wraps after about 71 minutes).
+	@details	It can be called by interrupts, e.g. to timestamp sensor frames.
+	@return	Return value is time in microseconds.
+*/
+uint32_t hal_micros(void);
+
+/**
+	@brief	Function waits given time. Sensor frames are still produced while waiting.
+	@param	value Time in milliseconds
+*/
+void hal_delayMs( uint32_t value );
+
+
+// Control timer
+/**
+	@brief	Function starts periodic control interrupt, which calls ::zm_controlTick.
+	@details	KL46Z: PIT channel 0 with priority below sensor and motor interrupts, so the tick always sees complete frame
+						and it can wait for PWM update.
+						Host: ticks are fired while virtual clock is moved forward (::hal_sensorSync, ::hal_delayMs).
+	@param	rate_hz Tick frequency [Hz].
+*/
+void hal_controlStart( uint16_t rate_hz );
+
+/**
+	@brief	Function stops control interrupt. Tick which is running is completed first.
+*/
+void hal_controlStop(void);
+
+
+// Stack use
+/**
+	@brief	Function fills free part of stack with pattern, so ::hal_stackUsed finds the deepest use later. Call it at start of main.
+*/
+void hal_stackPaint(void);
+
+/**
+	@brief	Function returns the deepest stack use since ::hal_stackPaint, including nested interrupts (control tick, sensors, UART).
+	@return	Return value is number of bytes (host: 0, stack is not measured).
+*/
+uint16_t hal_stackUsed(void);
+
+
+// Record flash
+/**
+	@brief	Function returns memory-mapped content of record sector (0xFF bytes when erased).
+	@details	KL46Z: the last program flash sector (0x3FC00), excluded from linker memory in Keil project.
+						Host: RAM copy of file selected with ::hal_host_setFlashFile.
+*/
+const uint8_t * hal_flashSector(void);
+
+/**
+	@brief	Function erases record sector (all bytes become 0xFF).
+	@return	Return value is 0 on success, -1 on error.
+*/
+int8_t hal_flashErase(void);
+
+/**
+	@brief	Function programs data in record sector. Programming can only clear bits, so the area should be erased.
+	@param	offset Offset in sector, multiple of 4.
+	@param	data Pointer to data.
+	@param	size Number of bytes, multiple of 4.
+	@return	Return value is 0 on success, -1 on error (bad arguments or flash error).
+*/
+int8_t hal_flashWrite( uint32_t offset, const void * data, uint32_t size );
+
+#endif
@@ -0,0 +1,853 @@
+/**
+	@file		zumo_hal_kl46z.c
+	@brief		Hardware abstraction layer - Freescale KL46Z backend
+	@details	Requirements (hardware and software):
+						<ul>
+							<li> Sensor pinout (from left): PTA4, PTC1, PTD6, PTC2, PTD3,PTA5.
+							<li> Sensor timer: LPTMR or TPM2 channel 0 (see ::LA_TIMER_TPM).
+							<li> Sensor sampling: pin interrupts or periodic timer interrupt (see ::LA_SAMPLING_POLL).
+							<li> Motors: PTA13 (phase left), PTC9 (phase right), PTD4 TPM0_CH4 (PWM left), PTD2 TPM0_CH2 (PWM right).
+							<li> Control loop: PIT channel 0.
+							<li> CLOCK_SETUP  in system_MKL46Z4.c  equals 1
+						</ul>
+*/
+
+#include "MKL46Z4.h"
+#include "zumo_hal.h"
+#include "zumo_ledArray.h"
+#include "zumo_maze.h"
+#include "bluetooth.h"
+
+#define MOTOR_LEFT_PHASE	(1ul<<13)
+#define MOTOR_RIGHT_PHASE	(1ul<<9)
+
+
+// Sensor frame source
+static volatile uint16_t raw[ HAL_NBR_OF_SENSORS ];		/**< Discharge times of current frame */
+static volatile uint8_t measured = 0;									/**< Counter how many sensors has been readed */
+static volatile uint8_t discharging = 0;								/**< 1 - capacitors are charged and timer counts discharge time up to ::la_frameTimeout */
+static volatile uint16_t timeout;												/**< Timeout of current frame */
+#if LA_SAMPLING_POLL
+static volatile uint8_t pending;												/**< Sensors which are not discharged yet (bit i - raw[i]) */
+static volatile uint32_t elapsed;												/**< Time of the last sample since pins became inputs [timer ticks] */
+#endif
+
+// Motor sink
+static volatile uint8_t CH2_CnV_Busy = 0;
+static volatile uint8_t CH4_CnV_Busy = 0;
+
+// Millisecond clock
+static volatile uint32_t millis = 0;
+static uint32_t us_per_tick;		/**< Microseconds per SysTick tick, Q20 (::hal_micros multiplies, sensor interrupt reads time of each frame) */
+
+// Control timer
+#define PIT_IRQ_PRIORITY 2		/**< Below sensors, TPM0 (0) and UART (::UART_IRQ_PRIORITY) */
+
+// Stack use
+#define STACK_SIZE 0x800							/**< Stack_Size in startup_MKL46Z4.s */
+#define STACK_PATTERN 0xC5C5C5C5ul		/**< Value of words which were not used */
+
+
+/**
+	@brief	This function prepares LED array pins (multiplexers, pull-up/pull-down resistors, NVIC)
+*/
+static void la_pins_init(void){
+
+	//
+	SIM->SCGC5 |= SIM_SCGC5_PORTA_MASK | SIM_SCGC5_PORTC_MASK | SIM_SCGC5_PORTD_MASK;
+	PORTA->PCR[4] &= ~PORT_PCR_MUX_MASK;
+	PORTC->PCR[1] &= ~PORT_PCR_MUX_MASK;
+	PORTD->PCR[6] &= ~PORT_PCR_MUX_MASK;
+	PORTC->PCR[2] &= ~PORT_PCR_MUX_MASK;
+	PORTD->PCR[3] &= ~PORT_PCR_MUX_MASK;
+	PORTA->PCR[5] &= ~PORT_PCR_MUX_MASK;
+
+	PORTA->PCR[4] |= PORT_PCR_MUX(1);
+	PORTC->PCR[1] |= PORT_PCR_MUX(1);
+	PORTD->PCR[6] |= PORT_PCR_MUX(1);
+	PORTC->PCR[2] |= PORT_PCR_MUX(1);
+	PORTD->PCR[3] |= PORT_PCR_MUX(1);
+	PORTA->PCR[5] |= PORT_PCR_MUX(1);
+
+	PORTA->PCR[4] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
+	PORTC->PCR[1] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
+	PORTD->PCR[6] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
+	PORTC->PCR[2] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
+	PORTD->PCR[3] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
+	PORTA->PCR[5] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
+
+#if !LA_SAMPLING_POLL
+	NVIC_ClearPendingIRQ(PORTC_PORTD_IRQn);				/* Clear NVIC any pending interrupts on PORTC_D */
+	NVIC_ClearPendingIRQ(PORTA_IRQn);				/* Clear NVIC any pending interrupts on PORTC_A */
+	NVIC_EnableIRQ(PORTC_PORTD_IRQn);
+	NVIC_EnableIRQ(PORTA_IRQn);
+#endif
+}
+
+/**
+	@brief	As the name suggests, function sets pins as inputs and enables interrupts
+*/
+static void la_pins_as_inputs(void){
+
+	FPTA->PDDR &= ~( (1ul<<4) | (1ul<<5) );
+	FPTC->PDDR &= ~( (1ul<<1) | (1ul<<2) );
+	FPTD->PDDR &= ~( (1ul<<3) | (1ul<<6) );
+
+#if !LA_SAMPLING_POLL
+	// Forget edges of previous frame closed by timeout
+	PORTA->ISFR = (1ul<<4) | (1ul<<5);
+	PORTC->ISFR = (1ul<<1) | (1ul<<2);
+	PORTD->ISFR = (1ul<<3) | (1ul<<6);
+
+	// Enable the interrupts
+	PORTA->PCR[4] |= PORT_PCR_IRQC(10);   // Interrupt on falling edge
+	PORTC->PCR[1] |= PORT_PCR_IRQC(10);
+	PORTD->PCR[6] |= PORT_PCR_IRQC(10);
+	PORTC->PCR[2] |= PORT_PCR_IRQC(10);
+	PORTD->PCR[3] |= PORT_PCR_IRQC(10);
+	PORTA->PCR[5] |= PORT_PCR_IRQC(10);
+#endif
+}
+
+/**
+	@brief	Function sets pins as outputs and disables interrupts
+*/
+static void la_pins_as_outputs_and_high(void){
+
+	// Disable the interrupts
+	PORTA->PCR[4] &= ~PORT_PCR_IRQC_MASK;		// left side (top view)
+	PORTC->PCR[1] &= ~PORT_PCR_IRQC_MASK;
+	PORTD->PCR[6] &= ~PORT_PCR_IRQC_MASK;
+	PORTC->PCR[2] &= ~PORT_PCR_IRQC_MASK;
+	PORTD->PCR[3] &= ~PORT_PCR_IRQC_MASK;
+	PORTA->PCR[5] &= ~PORT_PCR_IRQC_MASK;		// right side (top view)
+
+	FPTA->PDDR |= (1ul<<4) | (1ul<<5);
+	FPTC->PDDR |= (1ul<<1) | (1ul<<2);
+	FPTD->PDDR |= (1ul<<3) | (1ul<<6);
+
+	FPTA->PSOR |= (1ul<<4) | (1ul<<5);
+	FPTC->PSOR |= (1ul<<1) | (1ul<<2);
+	FPTD->PSOR |= (1ul<<3) | (1ul<<6);
+}
+
+#if LA_TIMER_TPM
+static volatile uint16_t tpm_start;		/**< TPM2 counter when timer was reloaded */
+#else
+/**
+	@brief	This function resets LPTMR and set time value
+	@param	time This value will be writtenn to LPTMR_CMR_COMPARE register
+*/
+static void lptimer_reload( uint16_t time ){
+
+	LPTMR0->CSR &= ~( LPTMR_CSR_TEN_MASK | LPTMR_CSR_TIE_MASK );			/* Disable timer to clear timer register*/
+	LPTMR0->CMR = LPTMR_CMR_COMPARE( time );
+	LPTMR0->CSR |=  LPTMR_CSR_TEN_MASK | LPTMR_CSR_TIE_MASK; /* Enable LPTMR timer and interupt */
+}
+
+/**
+	@brief	This function reads CNR register.
+	@details	We had to create this function because each reading of this register has to be preceded by writing something to it.
+	@return	Return value is number from LPTMR CNR
+*/
+static uint16_t la_getLptmrCNR(void){
+
+	// Create a pinter to CNR register (Keil does not allow to write something to this register. In it's opinion it is read-only register)
+	uint32_t * point = (uint32_t*)0x4004000Cu;
+	*point = 0;		// Write something
+	return LPTMR0->CNR;	// Get valid data
+}
+#endif
+
+/**
+	@brief	This function starts counting of sensor timer from zero and sets its interrupt after given time.
+	@details	LPTMR counter is cleared. TPM2 counter runs freely, so channel 0 compares it with start plus time.
+	@param	time Number of timer ticks (::LA_TIMER_HZ).
+*/
+static void la_timerReload( uint16_t time ){
+
+#if LA_TIMER_TPM
+	tpm_start = (uint16_t)TPM2->CNT;
+	TPM2->CONTROLS[0].CnV = (uint16_t)(tpm_start + time);
+	TPM2->CONTROLS[0].CnSC |= TPM_CnSC_CHF_MASK;				// Clear old compare
+#else
+	lptimer_reload( time );
+#endif
+}
+
+#if LA_SAMPLING_POLL
+/**
+	@brief	This function sets the next interrupt of sensor timer at given time since ::la_timerReload.
+	@details	LPTMR counter is cleared at compare, so it repeats reloaded period by itself.
+	@param	time Number of timer ticks, it has to be a multiple of period given to ::la_timerReload.
+*/
+static void la_timerContinue( uint32_t time ){
+
+#if LA_TIMER_TPM
+	TPM2->CONTROLS[0].CnV = (uint16_t)(tpm_start + time);
+#else
+	(void)time;
+#endif
+}
+#else
+/**
+	@brief	This function returns timer ticks since ::la_timerReload.
+*/
+static uint16_t la_timerRead(void){
+
+#if LA_TIMER_TPM
+	return (uint16_t)(TPM2->CNT - tpm_start);
+#else
+	return la_getLptmrCNR();
+#endif
+}
+#endif
+
+/**
+	@brief	Function closes the frame.
+*/
+static void la_closeFrame(void){
+
+	measured = 0;																			// Reset the counter
+	discharging = 0;
+	la_pins_as_outputs_and_high();										// Discharge capacitors
+	la_timerReload( LA_DELAY_CAP_DISCHARGE );				// Set Discharge time
+
+	la_frameComplete( raw );													// Calibrate and calculate each sensor status
+}
+
+#if LA_SAMPLING_POLL
+/**
+	@brief	Function reads all sensor pins at once.
+	@return	Return value is mask of sensors which are still high (bit i - raw[i], from left).
+*/
+static uint8_t la_readPins(void){
+
+	uint32_t a = FPTA->PDIR, c = FPTC->PDIR, d = FPTD->PDIR;
+
+	// PTA4, PTC1, PTD6, PTC2, PTD3, PTA5 - each bit is moved to its place with one shift
+	return (uint8_t)( ((a >> 4) & 0x01) | (c & 0x02) | ((d >> 4) & 0x04) | ((c << 1) & 0x08) | ((d << 1) & 0x10) | (a & 0x20) );
+}
+
+/**
+	@brief	Function samples all sensors in one pass, it is called by timer every ::LA_POLL_PERIOD while capacitors discharge.
+	@details	Each sensor which is low for the first time gets time of this sample.
+	@return	Return value is 1 when the next sample is set, 0 when frame has to be closed (each sensor is low or timeout).
+*/
+static uint8_t la_samplePins(void){
+
+	uint8_t low, i;
+
+	elapsed += LA_POLL_PERIOD;
+	low = pending & ~la_readPins();
+	pending &= ~low;
+	for(i=0; low; i++, low >>= 1){
+		if( low & 1 ) raw[i] = (uint16_t)elapsed;
+	}
+
+	if( pending == 0 || elapsed >= timeout ) return 0;
+	la_timerContinue( elapsed + LA_POLL_PERIOD );
+	return 1;
+}
+#else
+/**
+	@brief	Function closes the frame when each sensor has been readed.
+*/
+static void la_checkFrame(void){
+
+	// If each sensor has been readed...
+	if( measured == HAL_NBR_OF_SENSORS ) la_closeFrame();
+}
+#endif
+
+void hal_sensorInit(void){
+
+	la_pins_init();
+	la_pins_as_outputs_and_high();
+
+#if LA_TIMER_TPM
+	SIM->SCGC6 |= SIM_SCGC6_TPM2_MASK;				// Turn on TPM2 clock gate
+	SIM->SOPT2 |= SIM_SOPT2_TPMSRC(1);				// MCGPLLCLK/2 - the same source as motor PWM (TPM0)
+	SIM->SOPT2 |= SIM_SOPT2_PLLFLLSEL_MASK;
+
+	/* Free running 16-bit counter, channel 0 in software compare mode */
+	TPM2->SC = 0;
+	TPM2->CNT = 0;
+	TPM2->MOD = 0xFFFF;
+	TPM2->CONTROLS[0].CnSC = TPM_CnSC_MSA_MASK | TPM_CnSC_CHIE_MASK;
+	la_timerReload( LA_DELAY_CAP_DISCHARGE );
+
+	/* Enable interrupt*/
+	NVIC_ClearPendingIRQ(TPM2_IRQn);
+	NVIC_EnableIRQ(TPM2_IRQn);
+
+	TPM2->SC = TPM_SC_PS( LA_TPM_PRESCALER ) | TPM_SC_CMOD(1);
+#else
+	SIM->SCGC5 |= SIM_SCGC5_LPTMR_MASK; 	/*Turn on ADC Low Power Timer (LPTMR) registers clock gate*/
+
+	/* Configure LPTMR as timer in 'clear CNR in compare' mode*/
+	LPTMR0->CSR = (	LPTMR_CSR_TCF_MASK | LPTMR_CSR_TIE_MASK );
+	LPTMR0->PSR = ( LPTMR_PSR_PCS( 0 ) | LPTMR_PSR_PBYP_MASK );			/* Set 32kHz MCGIRCLK clock source. No prescaler selected */
+	LPTMR0->CMR = LPTMR_CMR_COMPARE( LA_DELAY_CAP_DISCHARGE );
+
+	/* Enable interrupt*/
+	NVIC_ClearPendingIRQ(LPTimer_IRQn); 	/* Clear any pending interrupt */
+	NVIC_EnableIRQ(LPTimer_IRQn);
+
+	LPTMR0->CSR |=  LPTMR_CSR_TEN_MASK;
+#endif
+}
+
+void hal_sensorSync(void){
+	// Frames are produced by interrupts.
+}
+
+/**
+	@brief	This function changes sensor pins direction. It works after charging sensor capacitors.
+	@details	The second interrupt of frame is timeout (::la_frameTimeout): sensors which are not discharged yet are dark,
+						so they get timeout as discharge time and the frame is closed without waiting for them.
+						When pins are sampled by timer (::LA_SAMPLING_POLL), the next interrupts are samples until frame is complete or timeout.
+*/
+static void la_timerEvent(void){
+
+	uint8_t i;
+
+	if( discharging ){
+#if LA_SAMPLING_POLL
+		if( la_samplePins() ) return;
+#endif
+		for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+			if( raw[i] > timeout ) raw[i] = timeout;
+		}
+		la_closeFrame();
+		return;
+	}
+
+	la_pins_as_outputs_and_high();
+	timeout = la_frameTimeout();
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++) raw[i] = 0xFFFF;		// Not discharged yet
+	measured = 0;																				// Edge latched while frame was closed is not counted
+	discharging = 1;
+#if LA_SAMPLING_POLL
+	pending = (1 << HAL_NBR_OF_SENSORS) - 1;
+	elapsed = 0;
+	la_timerReload( LA_POLL_PERIOD );										// Set the first sample
+#else
+	la_timerReload( timeout );													// Set maximum discharge time of this frame
+#endif
+	la_pins_as_inputs();
+}
+
+#if LA_TIMER_TPM
+void TPM2_IRQHandler(void){
+
+	TPM2->CONTROLS[0].CnSC |= TPM_CnSC_CHF_MASK;					// Clear interrupt flag
+	la_timerEvent();
+}
+#else
+void LPTimer_IRQHandler(void){
+
+	LPTMR0->CSR |=  LPTMR_CSR_TCF_MASK;										// Clear interrupt flag
+	la_timerEvent();
+}
+#endif
+
+#if !LA_SAMPLING_POLL
+/**
+	@brief	Voltage drop function for two sensors.
+	@details	This functions works simply. It decides which sensor has triggered the interrupt.
+						Reads it's time and saves it in array. When voltage on each sensor has dropped it reloads timer and sensor counter
+						and passes the frame to LED array library.
+*/
+void PORTA_IRQHandler(void){
+
+	if( PORTA->PCR[4] & PORT_PCR_ISF_MASK ){
+
+		raw[0] = la_timerRead();												// Read time of discharge
+		PORTA->PCR[4] |= PORT_PCR_ISF_MASK;						// Clear interrupt flag
+		measured++;																		// Increment counter of readed
+	}
+	else if( PORTA->PCR[5] & PORT_PCR_ISF_MASK ){
+
+		raw[5] = la_timerRead();
+		PORTA->PCR[5] |= PORT_PCR_ISF_MASK;
+		measured++;
+	}
+
+	la_checkFrame();
+}
+
+/**
+	@brief	Voltage drop function for four sensors.
+	@details	It works like ::PORTA_IRQHandler
+*/
+void PORTC_PORTD_IRQHandler(void){
+
+	if( PORTD->PCR[6] & PORT_PCR_ISF_MASK ){
+
+		raw[2] = la_timerRead();
+		PORTD->PCR[6] |= PORT_PCR_ISF_MASK;
+		measured++;
+	}
+	else if( PORTC->PCR[2] & PORT_PCR_ISF_MASK ){
+
+		raw[3] = la_timerRead();
+		PORTC->PCR[2] |= PORT_PCR_ISF_MASK;
+		measured++;
+	}
+	else if( PORTC->PCR[1] & PORT_PCR_ISF_MASK ){
+
+		raw[1] = la_timerRead();
+		PORTC->PCR[1] |= PORT_PCR_ISF_MASK;
+		measured++;
+	}
+	else if( PORTD->PCR[3] & PORT_PCR_ISF_MASK ){
+
+		raw[4] = la_timerRead();
+		PORTD->PCR[3] |= PORT_PCR_ISF_MASK;
+		measured++;
+	}
+
+	la_checkFrame();
+}
+#endif
+
+
+void TPM0_IRQHandler(void){
+
+	if( TPM0->SC & TPM_SC_TOF_MASK ){
+
+		if( CH2_CnV_Busy ) CH2_CnV_Busy = 0;
+		if( CH4_CnV_Busy ) CH4_CnV_Busy = 0;
+
+		TPM0->SC |= TPM_SC_TOF_MASK;
+	}
+}
+
+void hal_motorInit(void){
+
+	// CLOCK_SETUP 1
+	// 1 ... Multipurpose Clock Generator (MCG) in PLL Engaged External (PEE) mode
+  //       Reference clock source for MCG module is an external crystal 8MHz
+  //       Core clock = 48MHz, BusClock = 24MHz
+
+	//
+	SIM -> SCGC5 |= SIM_SCGC5_PORTA_MASK
+	              | SIM_SCGC5_PORTC_MASK
+	              | SIM_SCGC5_PORTD_MASK;
+
+	//
+	SIM -> SCGC6 |= SIM_SCGC6_TPM0_MASK;
+
+	//
+	//PORTA ->PCR[6] |= PORT_PCR_MUX(3); // TPM0_CH3 - encoder
+	PORTA ->PCR[13] |= PORT_PCR_MUX(1); // PHASE - Left
+	PORTC ->PCR[9] |= PORT_PCR_MUX(1); // PHASE - Right
+	PORTD ->PCR[2] |= PORT_PCR_MUX(4); // TPM0_CH2 - PWM - Right
+	PORTD ->PCR[4] |= PORT_PCR_MUX(4); // TPM0_CH4 - PWM - Left
+	//PORTD ->PCR[5] |= PORT_PCR_MUX(4); //TPM0_CH5 - encoder / to tez dioda zielona
+
+	// OUTPUT pin
+	PTA->PDDR |= MOTOR_LEFT_PHASE;
+	PTC->PDDR |= MOTOR_RIGHT_PHASE;
+
+
+
+	////////////////////// PWM /////////////////////////////////
+	//select source reference TMP0
+
+	SIM->SOPT2 |= SIM_SOPT2_TPMSRC(1); // ?set 'MCGFLLCLK clock or MCGPLLCLK/2'
+
+	SIM->SOPT2 |= SIM_SOPT2_PLLFLLSEL_MASK;// set "MCGPLLCLK clock with  fixed divide by two"
+
+	// set "up-counting"
+	TPM0->SC &= ~TPM_SC_CPWMS_MASK; // default set
+
+	// divide by 1
+	TPM0->SC &= ~TPM_SC_PS_MASK; // the same TPM_SC_PS(0)
+
+	// clear counter
+	TPM0->CNT = 0x00;
+
+	// set MOD for PWM period equal 1023 ( 10 bit)
+	TPM0->MOD = HAL_PWM_MOD;
+
+	//////////CHANNEL ENGINE ////////////////////////////////
+	//Right engine
+	// set TPM0 channel 2 - "Edge-aligned PWM High-true pulses"
+	TPM0->CONTROLS[2].CnSC |= TPM_CnSC_MSB_MASK |
+													  TPM_CnSC_ELSB_MASK;
+	// Default value for Right engine
+	while( CH2_CnV_Busy );
+	TPM0->CONTROLS[2].CnV = 0; // STOP
+	CH2_CnV_Busy = 1;
+
+	//Left engine
+	// set TPM0 channel 4 - "Edge-aligned PWM High-true pulses"
+	TPM0->CONTROLS[4].CnSC |= TPM_CnSC_MSB_MASK |
+													  TPM_CnSC_ELSB_MASK;
+	// Default value for Left engine
+	while( CH4_CnV_Busy );
+	TPM0->CONTROLS[4].CnV = 0; // STOP
+	CH4_CnV_Busy = 1;
+
+	TPM0->SC |= TPM_SC_TOIE_MASK;
+	NVIC_ClearPendingIRQ(TPM0_IRQn);				/* Clear NVIC any pending interrupts on PORTC_A */
+	NVIC_EnableIRQ(TPM0_IRQn);
+
+
+	// enable counter
+	TPM0->SC |= TPM_SC_CMOD(1);
+}
+
+void hal_motorWrite( hal_motor_t motor, uint8_t reverse, uint16_t duty ){
+
+	if( motor == HAL_MOTOR_LEFT ){
+
+		while( CH4_CnV_Busy );
+		if( reverse ) PTA->PSOR |= MOTOR_LEFT_PHASE;	// set 1 mean reverse
+		else PTA->PCOR |= MOTOR_LEFT_PHASE; 					// clear , set 0 mean forward
+		TPM0->CONTROLS[4].CnV = duty;
+		CH4_CnV_Busy = 1;
+	}
+	else{
+
+		while( CH2_CnV_Busy );
+		if( reverse ) PTC->PSOR |= MOTOR_RIGHT_PHASE;
+		else PTC->PCOR |= MOTOR_RIGHT_PHASE;
+		TPM0->CONTROLS[2].CnV = duty;
+		CH2_CnV_Busy = 1;
+	}
+}
+
+
+/**
+	@brief Interrupt handler
+	@details	It reacts to byte coming or empty D buffer (in UART module).
+						Received bytes are passed to ::bt_receiveChar.
+*/
+#if (UART_MODULE == 0)
+void UART0_IRQHandler(void){
+
+#elif (UART_MODULE == 1)
+void UART1_IRQHandler(void){
+
+#elif (UART_MODULE == 2)
+void UART2_IRQHandler(void){
+#endif
+
+	__disable_irq();
+
+	if(UART(UART_MODULE)->S1 & UART_S1_RDRF_MASK){
+
+		bt_receiveChar( UART(UART_MODULE)->D );
+	}
+
+	else if(UART(UART_MODULE)->S1 & UART_S1_TDRE_MASK){
+
+		if( buf_empty(&TxBuf) ){
+
+			// disable interrupt from transmitter
+			UART(UART_MODULE)->C2 &= ~UART_C2_TIE_MASK;
+
+			TxBuf.tail = TxBuf.head; // force pointers equalization
+			// Sometimes, when transmitter is hardly loaded,
+			// tail pointer stops to far. "Size" indicator still works fine.
+		}
+		// If Tx buffer isn't empty put in UART next character.
+		else	UART(UART_MODULE)->D = from_UART_buffer( &TxBuf );
+	}
+
+#if UART_MODULE==0
+	NVIC_ClearPendingIRQ(UART0_IRQn);
+#elif UART_MODULE==1
+	NVIC_ClearPendingIRQ(UART1_IRQn);
+#elif UART_MODULE==2
+	NVIC_ClearPendingIRQ(UART2_IRQn);
+#endif
+
+	__enable_irq();
+}
+
+void hal_uartInit( uint32_t baud_rate ){
+
+	uint32_t divisor;
+
+
+#if UART_MODULE==0
+	SIM->SCGC5 |= SIM_SCGC5_PORTA_MASK; 	// PTA14(TX) PTA15(RX) on mux(3) will be used.
+	SIM->SOPT2 |= SIM_SOPT2_UART0SRC(1);
+	SIM->SOPT2 |= SIM_SOPT2_PLLFLLSEL_MASK;
+	SIM->SCGC4 |= SIM_SCGC4_UART0_MASK;
+	PORTA->PCR[14] |= PORT_PCR_MUX(3);
+	PORTA->PCR[15] |= PORT_PCR_MUX(3);
+
+#elif UART_MODULE==1
+	SIM->SCGC4 |= SIM_SCGC4_UART1_MASK;		// 24MHz bus clk
+	SIM->SCGC5 |= SIM_SCGC5_PORTE_MASK; 	// PTE0(TX) PTE1(RX) on mux(3) will be used.
+	PORTE->PCR[0] |= PORT_PCR_MUX(3);
+	PORTE->PCR[1] |= PORT_PCR_MUX(3);
+
+#elif UART_MODULE==2
+	SIM->SCGC4 |= SIM_SCGC4_UART2_MASK;		// 24MHz bus clk
+	SIM->SCGC5 |= SIM_SCGC5_PORTE_MASK; 	// PTE16(TX) PTE17(RX) on mux(3) will be used.
+	PORTE->PCR[16] |= PORT_PCR_MUX(3);
+	PORTE->PCR[17] |= PORT_PCR_MUX(3);
+#endif
+
+	// UART module disable
+	UART(UART_MODULE)->C2 &= ~(UART_C2_TE_MASK | UART_C2_RE_MASK);
+
+	// Setting prescaler value
+#if UART_MODULE==0
+	divisor = (48000000/baud_rate)/16;
+#else
+	divisor = (24000000/baud_rate)/16;
+#endif
+
+	// Cearing prescaler register
+	UART(UART_MODULE)->BDH &= ~UART_BDH_SBR_MASK;
+	UART(UART_MODULE)->BDL &= ~UART_BDL_SBR_MASK;
+
+	// Writting prescaler value to right register
+	UART(UART_MODULE)->BDH |= UART_BDH_SBR(divisor>>8);
+	UART(UART_MODULE)->BDL |= UART_BDL_SBR(divisor);
+
+	// One stop bit
+	UART(UART_MODULE)->BDH &= ~UART_BDH_SBNS_MASK;
+	// No parity
+	UART(UART_MODULE)->C1 &= ~UART_C1_PE_MASK;
+	// 8-bit mode
+	UART(UART_MODULE)->C1 &= ~UART_C1_M_MASK;
+
+
+	// Interrupt settings
+#if UART_MODULE==0
+	NVIC_SetPriority(UART0_IRQn, UART_IRQ_PRIORITY);
+	NVIC_ClearPendingIRQ(UART0_IRQn);
+	NVIC_EnableIRQ(UART0_IRQn);
+
+#elif UART_MODULE==1
+	NVIC_SetPriority(UART1_IRQn, UART_IRQ_PRIORITY);
+	NVIC_ClearPendingIRQ(UART1_IRQn);
+	NVIC_EnableIRQ(UART1_IRQn);
+
+#elif UART_MODULE==2
+	NVIC_SetPriority(UART2_IRQn, UART_IRQ_PRIORITY);
+	NVIC_ClearPendingIRQ(UART2_IRQn);
+	NVIC_EnableIRQ(UART2_IRQn);
+#endif
+
+	// Interrupts enable
+	UART(UART_MODULE)->C2 |= (UART_C2_TIE_MASK | UART_C2_RIE_MASK);
+
+	// UART module enable
+	UART(UART_MODULE)->C2 |= (UART_C2_TE_MASK | UART_C2_RE_MASK);
+}
+
+void hal_uartKick(void){
+
+	if( !(UART(UART_MODULE)->C2 & UART_C2_TIE_MASK) ){
+		UART(UART_MODULE)->D = from_UART_buffer( &TxBuf );
+		UART(UART_MODULE)->C2 |= UART_C2_TIE_MASK;
+	}
+}
+
+
+/**
+	@brief	Millisecond clock interrupt.
+*/
+void SysTick_Handler(void){
+
+	millis++;
+}
+
+void hal_clockInit(void){
+
+	SysTick_Config( SystemCoreClock/1000 );		// 1 ms period
+	us_per_tick = (1ul << 20) / (SystemCoreClock / 1000000);		// rounded down, so time never goes back at millisecond change
+}
+
+uint32_t hal_millis(void){
+
+	return millis;
+}
+
+uint32_t hal_micros(void){
+
+	uint32_t ms, ticks, pending;
+	
+	// SysTick counts down from LOAD. Interrupt with higher priority can see it wrapped before millis is incremented.
+	do{
+		ms = millis;
+		ticks = SysTick->VAL;
+		pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+	}while( ms != millis );
+	if( pending && ticks > SysTick->LOAD / 2 ) ms++;
+	
+	// Product is below 1000 << 20, so it fits in 32 bits at any clock.
+	return ms * 1000 + (((SysTick->LOAD - ticks) * us_per_tick) >> 20);
+}
+
+void hal_delayMs( uint32_t value ){
+
+	uint32_t start = millis;
+	while( (millis - start) < value );
+}
+
+
+// Control timer
+/**
+	@brief	Control timer interrupt (PIT channel 0).
+	@details	Its priority is lower than priority of frame source, so ::la_frameComplete is never interrupted by the tick.
+						It is also lower than TPM0 priority, because ::hal_motorWrite waits for PWM update.
+*/
+void PIT_IRQHandler(void){
+
+	if( PIT->CHANNEL[0].TFLG & PIT_TFLG_TIF_MASK ){
+
+		PIT->CHANNEL[0].TFLG = PIT_TFLG_TIF_MASK;		// w1c
+		zm_controlTick();
+	}
+}
+
+void hal_controlStart( uint16_t rate_hz ){
+
+	uint32_t bus_clock = SystemCoreClock / (((SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV4_MASK) >> SIM_CLKDIV1_OUTDIV4_SHIFT) + 1);
+
+	SIM->SCGC6 |= SIM_SCGC6_PIT_MASK;							/* Enable clock for PIT */
+	PIT->MCR = PIT_MCR_FRZ_MASK;										/* Enable module, stop it in debug mode */
+
+	PIT->CHANNEL[0].TCTRL = 0;
+	PIT->CHANNEL[0].LDVAL = bus_clock / rate_hz - 1;
+	PIT->CHANNEL[0].TFLG = PIT_TFLG_TIF_MASK;
+
+	NVIC_SetPriority(PIT_IRQn, PIT_IRQ_PRIORITY);
+	NVIC_ClearPendingIRQ(PIT_IRQn);
+	NVIC_EnableIRQ(PIT_IRQn);
+
+	PIT->CHANNEL[0].TCTRL = PIT_TCTRL_TIE_MASK | PIT_TCTRL_TEN_MASK;
+}
+
+void hal_controlStop(void){
+
+	PIT->CHANNEL[0].TCTRL = 0;
+	NVIC_DisableIRQ(PIT_IRQn);
+	NVIC_ClearPendingIRQ(PIT_IRQn);
+}
+
+
+// Stack use
+/**
+	@brief	Function returns top of stack (initial stack pointer from vector table).
+*/
+static uint32_t * stack_top(void){
+
+	return (uint32_t *)((const uint32_t *)SCB->VTOR)[0];
+}
+
+void hal_stackPaint(void){
+
+	uint32_t * p = stack_top() - STACK_SIZE / 4;
+	uint32_t primask = __get_PRIMASK();
+
+	// Interrupt frame must not be painted over, so they wait. Words just below stack pointer are left for this function.
+	__disable_irq();
+	while( p < (uint32_t *)__get_MSP() - 8 ) *p++ = STACK_PATTERN;
+	__set_PRIMASK( primask );
+}
+
+uint16_t hal_stackUsed(void){
+
+	const uint32_t * top = stack_top();
+	const uint32_t * p = top - STACK_SIZE / 4;
+
+	while( p < top && *p == STACK_PATTERN ) p++;
+	return (uint16_t)((top - p) * 4);
+}
+
+
+// Record flash
+/**
+	@brief	Address of record sector - the last 1 KB sector of program flash. Keil project gives linker only 0x0 - 0x3FBFF.
+*/
+#define FLASH_RECORD_ADDRESS	0x3FC00ul
+
+/**
+	@brief	FTFA commands.
+*/
+#define FLASH_CMD_PROGRAM_LONGWORD	0x06
+#define FLASH_CMD_ERASE_SECTOR			0x09
+
+/**
+	@brief	Thumb code which launches FTFA command and waits for its end (r0 - address of FSTAT).
+	@details	Flash can not be read while command is running, so this loop is executed from RAM:
+						<pre>
+						movs r1, #0x80			; CCIF
+						strb r1, [r0]				; launch
+						ldrb r1, [r0]				; wait for CCIF
+						lsls r1, r1, #24
+						bpl  .-4
+						bx   lr
+						</pre>
+*/
+static uint16_t flash_launch_code[] = { 0x2180, 0x7001, 0x7801, 0x0609, 0xD5FC, 0x4770 };
+
+/**
+	@brief	Function runs prepared FTFA command with interrupts disabled (handlers are in flash too).
+	@return	Return value is 0 on success, -1 on access error, protection violation or verify failure.
+*/
+static int8_t flash_command(void){
+
+	void (*launch)( volatile uint8_t * fstat ) = (void (*)( volatile uint8_t * ))((uint32_t)flash_launch_code | 1);
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	launch( &FTFA->FSTAT );
+	__set_PRIMASK( primask );
+
+	return (FTFA->FSTAT & (FTFA_FSTAT_ACCERR_MASK | FTFA_FSTAT_FPVIOL_MASK | FTFA_FSTAT_MGSTAT0_MASK)) ? -1 : 0;
+}
+
+/**
+	@brief	Function waits for previous command and writes command code and address to FCCOB registers.
+*/
+static void flash_prepare( uint8_t command, uint32_t address ){
+
+	while( !(FTFA->FSTAT & FTFA_FSTAT_CCIF_MASK) );
+	FTFA->FSTAT = FTFA_FSTAT_ACCERR_MASK | FTFA_FSTAT_FPVIOL_MASK;		// Clear flags of previous command
+	FTFA->FCCOB0 = command;
+	FTFA->FCCOB1 = (uint8_t)(address >> 16);
+	FTFA->FCCOB2 = (uint8_t)(address >> 8);
+	FTFA->FCCOB3 = (uint8_t)address;
+}
+
+const uint8_t * hal_flashSector(void){
+
+	return (const uint8_t *)FLASH_RECORD_ADDRESS;
+}
+
+int8_t hal_flashErase(void){
+
+	flash_prepare( FLASH_CMD_ERASE_SECTOR, FLASH_RECORD_ADDRESS );
+	return flash_command();
+}
+
+int8_t hal_flashWrite( uint32_t offset, const void * data, uint32_t size ){
+
+	const uint8_t * bytes = (const uint8_t *)data;
+	uint32_t i;
+
+	if( (offset & 3) || (size & 3) || offset + size > HAL_FLASH_SECTOR_SIZE ) return -1;
+
+	for( i=0; i<size; i+=4 ){
+		flash_prepare( FLASH_CMD_PROGRAM_LONGWORD, FLASH_RECORD_ADDRESS + offset + i );
+		// Byte at the lowest address goes to FCCOB7
+		FTFA->FCCOB7 = bytes[i];
+		FTFA->FCCOB6 = bytes[i+1];
+		FTFA->FCCOB5 = bytes[i+2];
+		FTFA->FCCOB4 = bytes[i+3];
+		if( flash_command() ) return -1;
+	}
+	return 0;
+}
@@ -10,251 +10,440 @@
 						</ul>
 */
 
-#include "MKL46Z4.h"
+#include "zumo_hal.h"
 #include "zumo_ledArray.h"
 
 // Global variables
-volatile la_sensor_t ledArr[6];		/**< Six sensors array */
-volatile char la_state;						/**< Encoded status of each sensor (six last bits) */
-volatile uint8_t measured = 0;		/**< Counter how many sensors has been readed */
-volatile uint8_t cal_flag = 0;		/**< Calibration flag which allow LED array to perfotm self-calibration */
-volatile uint8_t valid_data = 0;	/**< Semaphore */
+HAL_STATE volatile la_sensor_t ledArr[6];		/**< Six sensors array */
+HAL_STATE volatile uint8_t cal_flag = 0;		/**< Calibration flag which allow LED array to perfotm self-calibration */
 
-void la_init(void){
-	
-	la_pins_init();
-	la_pins_as_outputs_and_high();
-	
-	SIM->SCGC5 |= SIM_SCGC5_LPTMR_MASK; 	/*Turn on ADC Low Power Timer (LPTMR) registers clock gate*/ 	 
-	
-	/* Configure LPTMR as timer in 'clear CNR in compare' mode*/ 
-	LPTMR0->CSR = (	LPTMR_CSR_TCF_MASK | LPTMR_CSR_TIE_MASK );
-	LPTMR0->PSR = ( LPTMR_PSR_PCS( 0 ) | LPTMR_PSR_PBYP_MASK );			/* Set 32kHz MCGIRCLK clock source. No prescaler selected */
-	LPTMR0->CMR = LPTMR_CMR_COMPARE( LA_LPTMR_DELAY_CAP_DISCHARGE );
+/**
+	@brief	Ring of recent frames (::LA_HISTORY). Frame source writes the slot after the published one, then publishes it by ::la_seq.
+*/
+static HAL_STATE volatile la_frame_t la_frames[ LA_HISTORY ];
+static HAL_STATE volatile uint32_t la_seq = 0;		/**< Sequence number of the last complete frame, it is in ::LA_FRAME( la_seq ) */
 
-	/* Enable interrupt*/
-	NVIC_ClearPendingIRQ(LPTimer_IRQn); 	/* Clear any pending interrupt */
-	NVIC_EnableIRQ(LPTimer_IRQn);
-		
-	LPTMR0->CSR |=  LPTMR_CSR_TEN_MASK;
-}
+/**
+	@brief	Slot of ring which holds frame with given sequence number.
+*/
+#define LA_FRAME(seq) la_frames[ (seq) & (LA_HISTORY - 1) ]
 
-void la_startCal(void){
-	cal_flag = 1;
-}
-void la_stopCal(void){
-	cal_flag = 0;
+/**
+	@brief	Condition of copy from the ring: frames seq-used+1 ... seq were not overwritten while they were read.
+	@details	Frame source writes slot of frame la_seq+1-::LA_HISTORY, so copy of 'used' frames must be repeated
+						when more than ::LA_HISTORY - used frames were published since 'seq'.
+*/
+#define LA_OVERWRITTEN(seq, used) ( la_seq - (seq) >= (uint32_t)(LA_HISTORY - (used)) )
+static HAL_STATE la_frame_t la_waited;						/**< Frame returned by the last ::la_waitSensorState */
+static HAL_STATE volatile uint16_t la_timeout = LA_DELAY_CAP_MAX_CHARGE;		/**< Frame timeout prepared with switching levels (see ::la_frameTimeout) */
+
+// Online calibration (see ::la_trackFrame)
+static HAL_STATE uint8_t la_tracking = 0;											/**< 1 - each sensor is calibrated, so it can be tracked */
+static HAL_STATE uint32_t la_white[ HAL_NBR_OF_SENSORS ];			/**< Tracked discharge time over white board << ::LA_TRACK_SHIFT */
+static HAL_STATE uint32_t la_black[ HAL_NBR_OF_SENSORS ];			/**< Tracked discharge time over black line << ::LA_TRACK_SHIFT */
+static HAL_STATE uint16_t la_tracked = 0;											/**< Frames tracked since the last publication */
+static HAL_STATE volatile la_sensor_t la_next[ HAL_NBR_OF_SENSORS ];		/**< Calibration published to frame source */
+static HAL_STATE volatile uint16_t la_nextTimeout;						/**< Frame timeout of ::la_next */
+static HAL_STATE volatile uint8_t la_nextReady = 0;						/**< 1 - ::la_next is complete, frame source takes it before the next frame */
+static HAL_STATE volatile uint8_t la_calChanged = 0;					/**< 1 - minimum or maximum moved since the last ::la_updateCal */
+
+/**
+	@brief	Function returns the smallest raw value, whose reflectance 100 - 100*(value-min)/(max-min) is below given level.
+*/
+static uint16_t la_switchingLevel( volatile la_sensor_t * sensor, int16_t level ){
+	
+	uint32_t range = sensor->max - sensor->min;
+	uint32_t value;
+	
+	if( level > 100 ) level = 100;
+	// Integer reflectance is below level when 100*(value-min) >= (101-level)*(max-min).
+	value = sensor->min + ((101 - level) * range + 99) / 100;
+	return (value < 0xFFFF) ? (uint16_t)value : 0xFFFF;
 }
 
-void la_pins_init(void){
-	
-	// 
-	SIM->SCGC5 |= SIM_SCGC5_PORTA_MASK | SIM_SCGC5_PORTC_MASK | SIM_SCGC5_PORTD_MASK;
-	PORTA->PCR[4] &= ~PORT_PCR_MUX_MASK;
-	PORTC->PCR[1] &= ~PORT_PCR_MUX_MASK;
-	PORTD->PCR[6] &= ~PORT_PCR_MUX_MASK;
-	PORTC->PCR[2] &= ~PORT_PCR_MUX_MASK;
-	PORTD->PCR[3] &= ~PORT_PCR_MUX_MASK;
-	PORTA->PCR[5] &= ~PORT_PCR_MUX_MASK;
-
-	PORTA->PCR[4] |= PORT_PCR_MUX(1);
-	PORTC->PCR[1] |= PORT_PCR_MUX(1);
-	PORTD->PCR[6] |= PORT_PCR_MUX(1);
-	PORTC->PCR[2] |= PORT_PCR_MUX(1);
-	PORTD->PCR[3] |= PORT_PCR_MUX(1);
-	PORTA->PCR[5] |= PORT_PCR_MUX(1);	
-
-	PORTA->PCR[4] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
-	PORTC->PCR[1] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
-	PORTD->PCR[6] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
-	PORTC->PCR[2] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
-	PORTD->PCR[3] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
-	PORTA->PCR[5] &= ~(PORT_PCR_PE_MASK | PORT_PCR_PS_MASK);
-		
-	NVIC_ClearPendingIRQ(PORTC_PORTD_IRQn);				/* Clear NVIC any pending interrupts on PORTC_D */
-	NVIC_ClearPendingIRQ(PORTA_IRQn);				/* Clear NVIC any pending interrupts on PORTC_A */
-	NVIC_EnableIRQ(PORTC_PORTD_IRQn);
-	NVIC_EnableIRQ(PORTA_IRQn);
+/**
+	@brief	Function prepares darkness scale and switching levels of each sensor from its minimum and maximum.
+	@param	sensor_array Pointer to buffer structure
+	@return	Return value is frame timeout for these levels (see ::la_frameTimeout).
+*/
+static uint16_t la_prepareScale( volatile la_sensor_t * sensor_array ){
+	
+	uint16_t timeout = 0, close;
+	uint8_t i;
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		if( (sensor_array+i)->max > (sensor_array+i)->min ){
+			(sensor_array+i)->scale = (1000ul << 16) / ((sensor_array+i)->max - (sensor_array+i)->min);
+			(sensor_array+i)->level[0] = la_switchingLevel( sensor_array+i, LA_PERCENTAGE_SWITCHING_LEVEL );
+			(sensor_array+i)->level[1] = la_switchingLevel( sensor_array+i, LA_PERCENTAGE_SWITCHING_LEVEL + LA_PERCENTAGE_HYSTERESIS );
+		}
+		else{
+			(sensor_array+i)->scale = 0;
+			(sensor_array+i)->level[0] = 0xFFFF;
+			(sensor_array+i)->level[1] = 0xFFFF;
+		}
+		// Dark sensor stays dark above level[0] (level[1] is not higher), its darkness is kept up to close level.
+		close = ((sensor_array+i)->scale != 0) ? la_switchingLevel( sensor_array+i, LA_PERCENTAGE_CLOSE_LEVEL ) : 0xFFFF;
+		if( close > timeout ) timeout = close;
+	}
+	return (timeout < LA_DELAY_CAP_MAX_CHARGE) ? timeout : LA_DELAY_CAP_MAX_CHARGE;
 }
 
-void la_pins_as_inputs(void){
+/**
+	@brief	Function starts online calibration from minimum and maximum of each sensor (see ::la_trackFrame).
+*/
+static void la_trackStart( void ){
 	
-	FPTA->PDDR &= ~( (1ul<<4) | (1ul<<5) );
-	FPTC->PDDR &= ~( (1ul<<1) | (1ul<<2) );
-	FPTD->PDDR &= ~( (1ul<<3) | (1ul<<6) );
+	uint8_t i;
 	
-	// Enable the interrupts
-	PORTA->PCR[4] |= PORT_PCR_IRQC(10);   // Interrupt on falling edge
-	PORTC->PCR[1] |= PORT_PCR_IRQC(10);
-	PORTD->PCR[6] |= PORT_PCR_IRQC(10);
-	PORTC->PCR[2] |= PORT_PCR_IRQC(10);
-	PORTD->PCR[3] |= PORT_PCR_IRQC(10);
-	PORTA->PCR[5] |= PORT_PCR_IRQC(10);		
+	la_nextReady = 0;
+	la_tracked = 0;
+	la_tracking = 1;
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		la_white[i] = (uint32_t)(ledArr+i)->min << LA_TRACK_SHIFT;
+		la_black[i] = (uint32_t)(ledArr+i)->max << LA_TRACK_SHIFT;
+		if( (ledArr+i)->max <= (ledArr+i)->min ) la_tracking = 0;		// sensor is not calibrated
+	}
 }
 
-void la_pins_as_outputs_and_high(void){
+void la_init(void){
 	
-	// Disable the interrupts
-	PORTA->PCR[4] &= ~PORT_PCR_IRQC_MASK;		// left side (top view)
-	PORTC->PCR[1] &= ~PORT_PCR_IRQC_MASK;
-	PORTD->PCR[6] &= ~PORT_PCR_IRQC_MASK;		
-	PORTC->PCR[2] &= ~PORT_PCR_IRQC_MASK;
-	PORTD->PCR[3] &= ~PORT_PCR_IRQC_MASK;
-	PORTA->PCR[5] &= ~PORT_PCR_IRQC_MASK;		// right side (top view)
-		
-	FPTA->PDDR |= (1ul<<4) | (1ul<<5);
-	FPTC->PDDR |= (1ul<<1) | (1ul<<2);
-	FPTD->PDDR |= (1ul<<3) | (1ul<<6);
+	uint8_t i;
 	
-	FPTA->PSOR |= (1ul<<4) | (1ul<<5);
-	FPTC->PSOR |= (1ul<<1) | (1ul<<2);
-	FPTD->PSOR |= (1ul<<3) | (1ul<<6);
+	// Forget previous calibration
+	for(i=0; i<6; i++){
+		(ledArr+i)->value = 0;
+		(ledArr+i)->min = 0;
+		(ledArr+i)->max = 0;
+		(ledArr+i)->scale = 0;
+		(ledArr+i)->level[0] = 0xFFFF;
+		(ledArr+i)->level[1] = 0xFFFF;
+	}
+	cal_flag = 0;
+	la_timeout = LA_DELAY_CAP_MAX_CHARGE;
+	la_trackStart();
+	
+	// No frame yet, line is in the center.
+	la_seq = 0;
+	for(i=0; i<LA_HISTORY; i++){
+		la_frames[i].seq = 0;
+		la_frames[i].state = 0;
+		la_frames[i].centroid = LA_POSITION_CENTER;
+		la_frames[i].darkness = 0;
+	}
+	la_waited.seq = 0;
+	
+	hal_sensorInit();
+}
+
+void la_startCal(void){
+	la_nextReady = 0;			// online calibration is stopped (see ::la_trackFrame)
+	la_calChanged = 1;
+	cal_flag = 1;
+}
+void la_stopCal(void){
+	la_nextReady = 0;			// levels of ::la_updateCal are not taken any more
+	cal_flag = 0;
+	la_timeout = la_prepareScale( ledArr );
+	la_trackStart();
 }
 
-void lptimer_reload( uint16_t time ){
+void la_getCal( la_cal_t * cal ){
 	
-	LPTMR0->CSR &= ~( LPTMR_CSR_TEN_MASK | LPTMR_CSR_TIE_MASK );			/* Disable timer to clear timer register*/
-	LPTMR0->CMR = LPTMR_CMR_COMPARE( time );	
-	LPTMR0->CSR |=  LPTMR_CSR_TEN_MASK | LPTMR_CSR_TIE_MASK; /* Enable LPTMR timer and interupt */	
+	uint8_t i;
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		cal->min[i] = (ledArr+i)->min;
+		cal->max[i] = (ledArr+i)->max;
+	}
 }
 
-uint16_t la_getLptmrCNR(void){
+void la_setCal( const la_cal_t * cal ){
 	
-	// Create a pinter to CNR register (Keil does not allow to write something to this register. In it's opinion it is read-only register)
-	uint32_t * point = (uint32_t*)0x4004000Cu;
-	*point = 0;		// Write something
-	return LPTMR0->CNR;	// Get valid data
+	uint8_t i;
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		(ledArr+i)->min = cal->min[i];
+		(ledArr+i)->max = cal->max[i];
+	}
+	la_timeout = la_prepareScale( ledArr );
+	la_trackStart();
 }
 
 void la_calibrateMinMax( volatile la_sensor_t * sensor_array ){
 	
 	uint8_t i;
 	for(i=0; i<6; i++){
-		if( (sensor_array+i)->value > (sensor_array+i)->max ) (sensor_array+i)->max = (sensor_array+i)->value;
-		if( (sensor_array+i)->value < (sensor_array+i)->min ) (sensor_array+i)->min = (sensor_array+i)->value;
+		if( (sensor_array+i)->value > (sensor_array+i)->max ){ (sensor_array+i)->max = (sensor_array+i)->value; la_calChanged = 1; }
+		if( (sensor_array+i)->value < (sensor_array+i)->min ){ (sensor_array+i)->min = (sensor_array+i)->value; la_calChanged = 1; }
 	}
 }
 
+void la_updateCal(void){
+	
+	uint8_t i;
+	
+	// Previous levels are not taken yet (no frame since then), or there is nothing new.
+	if( cal_flag == 0 || la_nextReady || !la_calChanged ) return;
+	la_calChanged = 0;
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		la_next[i].min = (ledArr+i)->min;
+		la_next[i].max = (ledArr+i)->max;
+	}
+	la_nextTimeout = la_prepareScale( la_next );		// divisions are done here, not in frame source
+	la_nextReady = 1;
+}
+
 void la_getPercentageReflectance( int16_t * output_array ){
 	
 	uint8_t i;
 	for(i=0; i<6; i++){
+		if( (ledArr+i)->max == (ledArr+i)->min ){ *(output_array+i) = 100; continue; }
 		*(output_array+i) = 100 - (100 * ((ledArr+i)->value - (ledArr+i)->min) / ((ledArr+i)->max - (ledArr+i)->min));
 	}
 }
 
-char la_calculateSensorState( volatile la_sensor_t * sensor_array ){
+char la_calculateSensorState( volatile la_sensor_t * sensor_array, char previous ){
 	
 	char state = 0;
 	uint8_t i;
-	int16_t temp;
 	
 	for(i=0; i<6; i++){
-		// rotate left
-		state <<= 1;
-		// calculate reflectance
-		temp = 100 - (100 * ((sensor_array+i)->value - (sensor_array+i)->min) / ((sensor_array+i)->max - (sensor_array+i)->min));
-		// if reflectance is smaller than 
-		if( temp < LA_PERCENTAGE_SWITCHING_LEVEL ) state |= 0x01;
+		// rotate left and add sensor bit. Dark sensor stays dark down to lower level (hysteresis), no division and no branch.
+		state = (state << 1) | ((sensor_array+i)->value >= (sensor_array+i)->level[ (previous >> (5 - i)) & 1 ]);
 	}
 	return state;
 }
 
-char la_getSensorState( void ){
-
-	while( valid_data == 0 );	// If data are changing, wait a while.
-	return la_state;
-}
-
 /**
-	@brief	This function changes sensor pins direction. It works after charging sensor capacitors.
+	@brief	Function sums darkness of sensors for line position (weighted centroid of calibrated darkness, see ::la_framePosition).
+	@param	sensor_array Pointer to sensors.
+	@param	last The previous frame.
+	@param[out]	frame Frame which gets centroid and darkness.
 */
-void LPTimer_IRQHandler(void){		
+static void la_calculatePosition( volatile la_sensor_t * sensor_array, const volatile la_frame_t * last, volatile la_frame_t * frame ){
+	
+	uint16_t sum = 0, weighted = 0;
+	uint16_t dark;
+	uint8_t on_line = 0;
+	uint8_t i;
+	
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		// calibrated darkness 0 - 1000
+		if( (sensor_array+i)->value <= (sensor_array+i)->min ) dark = 0;
+		else if( (sensor_array+i)->value >= (sensor_array+i)->max ) dark = ((sensor_array+i)->scale != 0) ? 1000 : 0;
+		else dark = (uint16_t)((((uint32_t)(sensor_array+i)->value - (sensor_array+i)->min) * (sensor_array+i)->scale) >> 16);
+		
+		if( dark > LA_POSITION_LINE ) on_line = 1;
+		if( dark > LA_POSITION_NOISE ){
+			sum += dark;
+			weighted += dark * i;
+		}
+	}
+	
+	// Line lost - it is on the side where it was seen for the last time (compared without division).
+	if( !on_line ){
+		if( last->darkness != 0 ) frame->centroid = ((uint32_t)last->centroid * 1000 < (uint32_t)LA_POSITION_CENTER * last->darkness) ? 0 : LA_POSITION_MAX;
+		else frame->centroid = (last->centroid < LA_POSITION_CENTER) ? 0 : LA_POSITION_MAX;
+		frame->darkness = 0;
+		return;
+	}
+	frame->centroid = weighted;
+	frame->darkness = sum;
+}
 
-	la_pins_as_outputs_and_high();
-	LPTMR0->CSR |=  LPTMR_CSR_TCF_MASK;										// Clear interrupt flag
-	lptimer_reload( LA_LPTMR_DELAY_CAP_MAX_CHARGE );		// Set maximum discharge time. If everything is ok it is useless.
-	la_pins_as_inputs();
+uint16_t la_framePosition( const la_frame_t * frame ){
+
+	if( frame->darkness == 0 ) return frame->centroid;
+	return (uint16_t)((uint32_t)frame->centroid * 1000 / frame->darkness);
 }
 
-/**
-	@brief	Voltage drop function for two sensors.
-	@details	This functions works simply. It decides which sensor has triggered the interrupt. 
-						Reads it's time and saves it in array. When voltage on each sensor has dropped it reloads timer and sensor counter
-						and calculates state of sensors.
-*/
-void PORTA_IRQHandler(void){
+uint32_t la_readFrame( la_frame_t * frame ){
+
+	uint32_t seq;
 	
-	if( PORTA->PCR[4] & PORT_PCR_ISF_MASK ){
+	// Frame source writes the next slot. This one is overwritten only after the whole ring is published, then copy is repeated.
+	do{
+		seq = la_seq;
+		*frame = LA_FRAME( seq );
+	}while( LA_OVERWRITTEN( seq, 1 ) );
+	return seq;
+}
 
-		(ledArr+0)->value = la_getLptmrCNR();					// Read time of discharge
-		PORTA->PCR[4] |= PORT_PCR_ISF_MASK;						// Clear interrupt flag
-		measured++;																		// Increment counter of readed
-	}
-	else if( PORTA->PCR[5] & PORT_PCR_ISF_MASK ){
-		
-		(ledArr+5)->value = la_getLptmrCNR();
-		PORTA->PCR[5] |= PORT_PCR_ISF_MASK;
-		measured++;
-	}
+uint8_t la_historyFrame( uint32_t seq, la_frame_t * frame ){
+
+	if( seq == 0 || seq > la_seq ) return 0;
+	*frame = LA_FRAME( seq );
+	return !LA_OVERWRITTEN( seq, 1 );
+}
+
+uint16_t la_historyAverage( uint8_t sensor, uint8_t frames ){
+
+	uint32_t seq, sum;
+	uint8_t i;
 	
-	// If each sensor has been readed...
-	if( measured == 6 ){
-		
-		measured = 0;																			// Reset the counter
-		la_pins_as_outputs_and_high();										// Discharge capacitors
-		lptimer_reload( LA_LPTMR_DELAY_CAP_DISCHARGE );			// Set Discharge time
+	if( frames > LA_HISTORY - 1 ) frames = LA_HISTORY - 1;
+	do{
+		seq = la_seq;
+		if( frames > seq ) frames = (uint8_t)seq;		// less frames since ::la_init
+		if( frames == 0 ) return 0;
 		
-		// If calibration is set
-		if( cal_flag == 1 ) la_calibrateMinMax( ledArr );	// calibrate the sensors
-		
-		valid_data = 0;																		// Set 'semaphore'
-		la_state = la_calculateSensorState( ledArr );			// Calculate each sensor status
-		valid_data = 1;																		// Release 'semaphore'
-	}
+		sum = 0;
+		for(i=0; i<frames; i++) sum += LA_FRAME( seq - i ).raw[ sensor ];
+	}while( LA_OVERWRITTEN( seq, frames ) );
+	return (uint16_t)(sum / frames);
 }
 
-/**
-	@brief	Voltage drop function for four sensors.
-	@details	It works like ::PORTA_IRQHandler
-*/
-void PORTC_PORTD_IRQHandler(void){
+uint8_t la_historyAge( char mask ){
+
+	uint32_t seq;
+	uint8_t age;
+	char state;
 	
-	if( PORTD->PCR[6] & PORT_PCR_ISF_MASK ){
+	do{
+		seq = la_seq;
+		state = LA_FRAME( seq ).state;
 		
-		(ledArr+2)->value = la_getLptmrCNR();
-		PORTD->PCR[6] |= PORT_PCR_ISF_MASK;
-		measured++;
+		// Go back while masked bits are the same as in the last frame.
+		for(age=0; age < LA_HISTORY_AGE_MAX && (uint32_t)age + 1 < seq; age++){
+			if( (LA_FRAME( seq - age - 1 ).state ^ state) & mask ) break;
+		}
+	}while( LA_OVERWRITTEN( seq, (age < LA_HISTORY_AGE_MAX) ? age + 2 : age + 1 ) );		// the oldest compared frame is in the ring
+	return age;
+}
+
+uint32_t la_historyRate( void ){
+
+	uint32_t seq, time_us;
+	uint8_t n;
+	
+	do{
+		seq = la_seq;
+		n = (seq > LA_HISTORY - 1) ? LA_HISTORY - 2 : (seq ? (uint8_t)(seq - 1) : 0);		// frame periods in the ring
+		if( n == 0 ) return 0;
+		time_us = LA_FRAME( seq ).time_us - LA_FRAME( seq - n ).time_us;
+	}while( LA_OVERWRITTEN( seq, n + 1 ) );
+	
+	if( time_us == 0 ) return 0;
+	return (n * 1000000UL + time_us / 2) / time_us;
+}
+
+void la_waitFrame( la_frame_t * frame ){
+
+	while( la_seq == frame->seq ) hal_sensorSync();
+	la_readFrame( frame );
+}
+
+char la_getSensorState( void ){
+
+	hal_sensorSync();					// Let the frame source produce data (host only).
+	return LA_FRAME( la_seq ).state;
+}
+
+char la_waitSensorState( void ){
+
+	la_waitFrame( &la_waited );
+	return la_waited.state;
+}
+
+uint32_t la_peekFrameNumber( void ){
+
+	return la_seq;
+}
+
+char la_peekSensorState( void ){
+
+	return LA_FRAME( la_seq ).state;
+}
+
+uint16_t la_peekLinePosition( void ){
+
+	la_frame_t frame;
+
+	la_readFrame( &frame );
+	return la_framePosition( &frame );
+}
+
+void la_trackFrame( const la_frame_t * frame ){
+	
+	uint8_t i, k, changed;
+	int16_t offset;
+	
+	if( LA_TRACK == 0 || cal_flag == 1 || la_tracking == 0 ) return;
+	
+	// Only line centered under two neighbouring sensors is sure: these two are black, the others are white.
+	for(k=0; k<HAL_NBR_OF_SENSORS-1; k++){
+		if( frame->state == (char)(0x30 >> k) ) break;
 	}
-	else if( PORTC->PCR[2] & PORT_PCR_ISF_MASK ){
-		
-		(ledArr+3)->value = la_getLptmrCNR();
-		PORTC->PCR[2] |= PORT_PCR_ISF_MASK;
-		measured++;
+	if( k == HAL_NBR_OF_SENSORS-1 ) return;
+	offset = (int16_t)la_framePosition( frame ) - (int16_t)(1000 * k + 500);
+	if( offset < -LA_TRACK_POSITION || offset > LA_TRACK_POSITION ) return;
+	
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		// Exponential moving average without division: x += raw - x/2^n (x is kept << n).
+		if( ((frame->state >> (5 - i)) & 1) == 0 ) la_white[i] += frame->raw[i] - (la_white[i] >> LA_TRACK_SHIFT);
+		else if( frame->timeout == LA_DELAY_CAP_MAX_CHARGE ) la_black[i] += frame->raw[i] - (la_black[i] >> LA_TRACK_SHIFT);
 	}
-	else if( PORTC->PCR[1] & PORT_PCR_ISF_MASK ){
-		
-		(ledArr+1)->value = la_getLptmrCNR();
-		PORTC->PCR[1] |= PORT_PCR_ISF_MASK;
-		measured++;
+	
+	// Previous calibration is not taken yet (no frame since then) - it is published later.
+	if( ++la_tracked < LA_TRACK_PUBLISH || la_nextReady ) return;
+	la_tracked = 0;
+	
+	changed = 0;
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		la_next[i].min = (uint16_t)(la_white[i] >> LA_TRACK_SHIFT);
+		la_next[i].max = (uint16_t)(la_black[i] >> LA_TRACK_SHIFT);
+		changed |= (la_next[i].min != (ledArr+i)->min) | (la_next[i].max != (ledArr+i)->max);
+		if( la_next[i].max <= la_next[i].min ) return;		// estimates crossed, sensor would be lost
 	}
-	else if( PORTD->PCR[3] & PORT_PCR_ISF_MASK ){
-		
-		(ledArr+4)->value = la_getLptmrCNR();
-		PORTD->PCR[3] |= PORT_PCR_ISF_MASK;
-		measured++;
+	if( !changed ) return;
+	la_nextTimeout = la_prepareScale( la_next );		// divisions are done here, not in frame source
+	la_nextReady = 1;
+}
+
+uint16_t la_frameTimeout( void ){
+
+	// Calibration needs the whole discharge of each sensor, online calibration needs it from time to time.
+	if( LA_EARLY_CLOSE == 0 || cal_flag == 1 ) return LA_DELAY_CAP_MAX_CHARGE;
+	if( LA_TRACK && ((la_seq + 1) & (LA_TRACK_FULL_FRAME - 1)) == 0 ) return LA_DELAY_CAP_MAX_CHARGE;
+	return la_timeout;
+}
+
+void la_frameComplete( const volatile uint16_t * raw ){
+
+	volatile la_frame_t * frame = &LA_FRAME( la_seq + 1 );
+	uint8_t i;
+	
+	// Timeout given to frame source when this frame was started
+	frame->timeout = la_frameTimeout();
+	
+	// Calibration prepared in background is taken between frames, so each frame is classified with one set of levels.
+	if( la_nextReady ){
+		for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+			// Minimum and maximum are still searched here while calibrating, only levels are taken then.
+			if( cal_flag == 0 ){
+				(ledArr+i)->min = la_next[i].min;
+				(ledArr+i)->max = la_next[i].max;
+			}
+			(ledArr+i)->scale = la_next[i].scale;
+			(ledArr+i)->level[0] = la_next[i].level[0];
+			(ledArr+i)->level[1] = la_next[i].level[1];
+		}
+		la_timeout = la_nextTimeout;
+		la_nextReady = 0;
 	}
 	
-	if( measured == 6 ){
-		
-		measured = 0;
-		la_pins_as_outputs_and_high();
-		lptimer_reload( LA_LPTMR_DELAY_CAP_DISCHARGE );
-		
-		if( cal_flag == 1 ) la_calibrateMinMax( ledArr );
-		
-		valid_data = 0;
-		la_state = la_calculateSensorState( ledArr );
-		valid_data = 1;
+	for(i=0; i<HAL_NBR_OF_SENSORS; i++){
+		(ledArr+i)->value = raw[i];
+		frame->raw[i] = raw[i];
 	}
+
+	// If calibration is set, calibrate the sensors (switching levels are moved by ::la_updateCal, no divisions here).
+	if( cal_flag == 1 ) la_calibrateMinMax( ledArr );
+
+	// Fill the slot after the published frame (the oldest one in the ring) ...
+	frame->state = la_calculateSensorState( ledArr, LA_FRAME( la_seq ).state );		// Calculate each sensor status
+	la_calculatePosition( ledArr, &LA_FRAME( la_seq ), frame );		// and position of line
+	frame->time_us = hal_micros();
+	frame->seq = la_seq + 1;
+	
+	// ... and publish it.
+	la_seq = frame->seq;
 }
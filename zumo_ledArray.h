@@ -13,23 +13,126 @@
 #ifndef ZUMO_LEDARRAY_H_
 #define ZUMO_LEDARRAY_H_
 
-#include "MKL46Z4.h"
+#include <stdint.h>
+#include "zumo_hal.h"
 
 /**
-  @brief	Number of periods 32kHz square wave enough to discharge capacitors
+	@brief	Timer of discharge times: 0 - LPTMR clocked from 32 kHz MCGIRCLK, 1 - TPM2 clocked from 48 MHz MCGPLLCLK/2.
+	@details	It can be selected by compiler option (-DLA_TIMER_TPM=1). Raw values and calibration are in ticks of selected timer (::LA_TIMER_HZ).
 */
-#define LA_LPTMR_DELAY_CAP_DISCHARGE	5
+#ifndef LA_TIMER_TPM
+#define LA_TIMER_TPM 0
+#endif
+
+#if LA_TIMER_TPM
+/**
+	@brief	TPM2 prescaler (clock is divided by 2^n), 6 MHz tick gives 10.9 ms of 16-bit discharge time.
+*/
+#define LA_TPM_PRESCALER 3
+#define LA_TIMER_HZ (48000000ul >> LA_TPM_PRESCALER)
+#else
+#define LA_TIMER_HZ 32768ul
+#endif
+
+/**
+	@brief	Sampling of sensor pins: 0 - interrupt on falling edge of each pin, 1 - one periodic timer interrupt reads all ports (see ::LA_POLL_PERIOD).
+	@details	It can be selected by compiler option (-DLA_SAMPLING_POLL=1).
+*/
+#ifndef LA_SAMPLING_POLL
+#define LA_SAMPLING_POLL 0
+#endif
+
+/**
+	@brief	Period of pin sampling [timer ticks] (4 periods of 32kHz square wave). Discharge time is rounded up to it.
+*/
+#define LA_POLL_PERIOD	((4 * LA_TIMER_HZ + 16384) / 32768)
+
+/**
+  @brief	Number of timer ticks enough to discharge capacitors (5 periods of 32kHz square wave)
+*/
+#define LA_DELAY_CAP_DISCHARGE	((5 * LA_TIMER_HZ + 16384) / 32768)
+
+/**
+  @brief Maximum number of timer ticks enough to charge capacitors. It is used only if some sensor is broken.
+*/
+#define LA_DELAY_CAP_MAX_CHARGE 0xffff
+
+/**
+	@brief	Early close of frame: 1 - frame is closed when each sensor is discharged or known dark (see ::la_frameTimeout), 0 - frame waits for each sensor.
+*/
+#define LA_EARLY_CLOSE 1
 
 /**
-  @brief Maximum number of periods 32kHz square wave enough to charge capacitors. It is used only if some sensor is broken.
+	@brief	Reflectance [percent] below which discharge time is cut by early close of frame (see ::la_frameTimeout).
+	@details	It is below ::LA_PERCENTAGE_SWITCHING_LEVEL, so darkness of sensors partly over line is still measured for line position.
+						Lower value gives more precise position over dark line and lower frame rate.
 */
-#define LA_LPTMR_DELAY_CAP_MAX_CHARGE 0xffff
+#ifndef LA_PERCENTAGE_CLOSE_LEVEL
+#define LA_PERCENTAGE_CLOSE_LEVEL 20
+#endif
 
 /**
   @brief	Threshold between black and white colour
 */
 #define LA_PERCENTAGE_SWITCHING_LEVEL 50
 
+/**
+	@brief	Hysteresis of sensor state [percent of reflectance]: dark sensor becomes white again above ::LA_PERCENTAGE_SWITCHING_LEVEL plus this value.
+	@details	0 - no hysteresis (each frame is classified on its own).
+*/
+#define LA_PERCENTAGE_HYSTERESIS 0
+
+/**
+	@brief	Online calibration: 1 - white and black of each sensor are tracked while line is followed (see ::la_trackFrame), 0 - calibration is fixed.
+*/
+#define LA_TRACK 1
+
+/**
+	@brief	The largest distance of line from the middle of two dark neighbouring sensors in frame used by online calibration.
+*/
+#define LA_TRACK_POSITION 100
+
+/**
+	@brief	Every n-th frame is not closed early (see ::la_frameTimeout), so black can be tracked. It has to be power of 2.
+*/
+#define LA_TRACK_FULL_FRAME 32
+
+/**
+	@brief	Online calibration moves white and black by 1/2^n of difference with each frame (time constant 2^n frames).
+*/
+#define LA_TRACK_SHIFT 8
+
+/**
+	@brief	Number of tracked frames after which new calibration is published to frame source.
+*/
+#define LA_TRACK_PUBLISH 64
+
+/**
+	@brief	Line position range (see ::la_peekLinePosition): 0 - line under the left sensor, ::LA_POSITION_MAX - under the right one.
+*/
+#define LA_POSITION_MAX (1000 * (HAL_NBR_OF_SENSORS - 1))
+#define LA_POSITION_CENTER (LA_POSITION_MAX / 2)
+
+/**
+	@brief	Calibrated darkness (0 - 1000) below which sensor is left out of line position (noise on white board).
+*/
+#define LA_POSITION_NOISE 50
+
+/**
+	@brief	Calibrated darkness (0 - 1000) which some sensor has to exceed, otherwise line is lost.
+*/
+#define LA_POSITION_LINE 200
+
+/**
+	@brief	Number of recent frames kept in ring (see ::la_historyFrame). It has to be power of 2.
+*/
+#define LA_HISTORY 16
+
+/**
+	@brief	The largest result of ::la_historyAge (masked bits did not change in whole ring).
+*/
+#define LA_HISTORY_AGE_MAX (LA_HISTORY - 2)
+
 /**
   @brief	Buffer structure for ::ledArr
 */
@@ -37,10 +140,33 @@ typedef struct{
 	uint16_t value;		/**< Current value */
 	uint16_t min;			/**< Registered in calibration mode minimum value */
 	uint16_t max;			/**< Registered in calibration mode maximum value */
+	uint32_t scale;		/**< 1000 * 65536 / (max - min), so darkness needs no division (0 - not calibrated) */
+	uint16_t level[2];	/**< The smallest value of dark sensor: [0] - when it was white, [1] - when it was dark (see ::LA_PERCENTAGE_HYSTERESIS). 0xFFFF - not calibrated */
 } la_sensor_t;
 
 /**
-	@brief	Function prepares LED array pins and LPTMR to work
+	@brief	Calibration of all sensors (see ::la_getCal, ::la_setCal).
+*/
+typedef struct{
+	uint16_t min[ HAL_NBR_OF_SENSORS ];		/**< Minimum value of each sensor */
+	uint16_t max[ HAL_NBR_OF_SENSORS ];		/**< Maximum value of each sensor */
+} la_cal_t;
+
+/**
+	@brief	One complete frame of sensor array (see ::la_readFrame).
+*/
+typedef struct{
+	uint32_t seq;															/**< Sequence number (1 - the first frame after ::la_init, 0 - no frame) */
+	uint32_t time_us;													/**< Time when frame was completed (::hal_micros) */
+	uint16_t raw[ HAL_NBR_OF_SENSORS ];				/**< Discharge time of each sensor, from left */
+	uint16_t timeout;													/**< Discharge time at which frame was closed (raw equal to it is dark, but not measured) */
+	uint16_t centroid;												/**< Sum of sensor index times its darkness, or line position when line is lost (see ::la_framePosition) */
+	uint16_t darkness;												/**< Sum of darkness of sensors (0 - line is lost) */
+	char state;																/**< Binary coded sensor state (last 6 bits, '1' means dark) */
+} la_frame_t;
+
+/**
+	@brief	Function prepares LED array pins and timer (::LA_TIMER_TPM) to work
 */
 void la_init(void);
 
@@ -50,10 +176,75 @@ void la_init(void);
 void la_startCal(void);
 
 /**
-	@brief	Function clears calibration flag.
+	@brief	Function clears calibration flag and prepares calibrated darkness scale and switching levels of each sensor.
 */
 void la_stopCal(void);
 
+/**
+	@brief	Function prepares switching levels from minimum and maximum found so far, while calibration flag is set.
+	@details	Frame source only searches minimum and maximum, and takes the levels before its next frame (divisions are not done in interrupt).
+						Call it in foreground loop which waits for sensor state during calibration. It does nothing when nothing has changed
+						or the previous levels were not taken yet.
+*/
+void la_updateCal(void);
+
+/**
+	@brief	Function copies calibration of each sensor (e.g. to save it in flash).
+	@param[out]	cal Pointer to destination.
+*/
+void la_getCal( la_cal_t * cal );
+
+/**
+	@brief	Function restores calibration saved with ::la_getCal, so ::zm_calibration can be skipped.
+	@param	cal Pointer to saved calibration.
+*/
+void la_setCal( const la_cal_t * cal );
+
+/**
+	@brief	This function copies the last complete frame without waiting (it can be called by any interrupt).
+	@details	Frames are kept in ring (::LA_HISTORY) and published by sequence number (seqlock), so the copy is never torn
+						and frame source is never blocked. Copy is repeated only when whole ring is overwritten meanwhile.
+	@param[out]	frame Pointer to destination.
+	@return	Return value is sequence number of the frame (0 - no frame yet).
+*/
+uint32_t la_readFrame( la_frame_t * frame );
+
+/**
+	@brief	This function copies frame with given sequence number from the ring of recent frames.
+	@param	seq Sequence number of the frame (see ::la_peekFrameNumber).
+	@param[out]	frame Pointer to destination.
+	@return	Return value is 1 when frame is valid, 0 when it is not complete yet or it was already overwritten.
+*/
+uint8_t la_historyFrame( uint32_t seq, la_frame_t * frame );
+
+/**
+	@brief	This function returns moving average of discharge time of one sensor.
+	@param	sensor Number of sensor (0 - left).
+	@param	frames Number of the last frames (up to ::LA_HISTORY - 1, less when there were not so many frames yet).
+	@return	Return value is mean discharge time (0 - no frame yet).
+*/
+uint16_t la_historyAverage( uint8_t sensor, uint8_t frames );
+
+/**
+	@brief	This function returns for how many frames the masked sensor state bits are not changed.
+	@param	mask Sensor state bits (e.g. 0x21 - outer sensors).
+	@return	Return value is number of frames completed after the change: 0 - bits changed in the last frame,
+					::LA_HISTORY_AGE_MAX - no change in the ring.
+*/
+uint8_t la_historyAge( char mask );
+
+/**
+	@brief	This function returns frame rate measured over the ring of recent frames.
+	@return	Return value is number of frames per second (0 - less than two frames yet).
+*/
+uint32_t la_historyRate(void);
+
+/**
+	@brief	This function waits for frame newer than the given one and copies it.
+	@param[in,out]	frame Pointer to the last frame seen by the caller (sequence number 0 - wait for the first one).
+*/
+void la_waitFrame( la_frame_t * frame );
+
 /**
 	@brief	This function returns status of each sensor.
 	@return	Return value is byte with binary coded sensor state (last 6 bits, '1' means dark).
@@ -61,52 +252,87 @@ void la_stopCal(void);
 char la_getSensorState(void);
 
 /**
-	@brief	This function calculates relative 'surface reflectivity'
-	@param	output_array Pointer to destination array.
-	@warning	Output array has to have six elements.
+	@brief	This function waits for frame completed after the one it returned last time and returns its status.
+	@details	Each frame is returned once, so it can feed state machines which count frames (e.g. ::zm_detectorStep).
+	@return	Return value is byte with binary coded sensor state (last 6 bits, '1' means dark).
 */
-void la_getPercentageReflectance( int16_t * output_array );
+char la_waitSensorState(void);
 
 /**
-	@brief	This function prepares LED array pins (multiplexers, pull-up/pull-down resistors, NVIC)
+	@brief	This function returns sequence number of the last complete frame (see ::la_frame_t).
 */
-void la_pins_init(void);
+uint32_t la_peekFrameNumber(void);
 
 /**
-	@brief	As the name suggests, function sets pins as inputs and enables interrupts
+	@brief	This function returns status of each sensor from the last complete frame without waiting for frame source.
+	@details	It is used by interrupts with priority lower than frame source (e.g. ::zm_controlTick), which always see complete frame.
+	@return	Return value is byte with binary coded sensor state (last 6 bits, '1' means dark).
 */
-void la_pins_as_inputs(void);
+char la_peekSensorState(void);
 
 /**
-	@brief	Function sets pins as outputs and disables interrupts
+	@brief	This function returns line position from the last complete frame without waiting for frame source.
+	@details	Position is weighted centroid of calibrated darkness of sensors (see ::la_framePosition).
+						When line is lost, it is the side where line was seen for the last time (0 or ::LA_POSITION_MAX).
+	@return	Return value is position in range 0 - ::LA_POSITION_MAX, ::LA_POSITION_CENTER means line under the center of array.
 */
-void la_pins_as_outputs_and_high(void);
+uint16_t la_peekLinePosition(void);
 
 /**
-	@brief	This function resets LPTMR and set time value
-	@param	time This value will be writtenn to LPTMR_CMR_COMPARE register
+	@brief	This function returns line position of frame (see ::la_peekLinePosition).
+	@details	Frame source only sums darkness of sensors, division of centroid is done here by reader of frame.
+	@param	frame Pointer to frame (see ::la_readFrame).
+	@return	Return value is position in range 0 - ::LA_POSITION_MAX.
 */
-void lptimer_reload( uint16_t time );
+uint16_t la_framePosition( const la_frame_t * frame );
 
 /**
-	@brief	This function reads CNR register.
-	@details	We had to create this function because each reading of this register has to be preceded by writing something to it.
-	@return	Return value is number from LPTMR CNR
+	@brief	This function calculates relative 'surface reflectivity'
+	@param	output_array Pointer to destination array.
+	@warning	Output array has to have six elements.
 */
-uint16_t la_getLptmrCNR(void);
+void la_getPercentageReflectance( int16_t * output_array );
 
 /**
-	@brief	This function decides which colour is under each sensor (1 means dark/black)
+	@brief	This function updates online calibration with frame in which line is followed (see ::LA_TRACK).
+	@details	White and black discharge time of each sensor are tracked only in frames with line centered under two neighbouring sensors
+						(see ::LA_TRACK_POSITION), black only in frames which are not closed early (see ::LA_TRACK_FULL_FRAME). Every ::LA_TRACK_PUBLISH frames darkness scale and switching levels are prepared from them and the frame source
+						takes them before the next frame, so each frame is classified with one set of levels and without division.
+						It is called with each new frame by code with priority lower than frame source (e.g. ::zm_controlTick).
+	@param	frame Pointer to frame (see ::la_readFrame).
+*/
+void la_trackFrame( const la_frame_t * frame );
+
+/**
+	@brief	This function returns discharge time after which frame source closes the frame.
+	@details	Sensor not discharged until then is dark anyway, so it is saved with this time. Timeout is the highest close level
+						of calibrated sensors (::LA_PERCENTAGE_CLOSE_LEVEL, see ::LA_EARLY_CLOSE), so frame over black line is not much longer than over switching level.
+	@return	Return value is timeout in timer ticks, ::LA_DELAY_CAP_MAX_CHARGE while calibrating, when some sensor is not calibrated
+					and in every ::LA_TRACK_FULL_FRAME-th frame.
+*/
+uint16_t la_frameTimeout(void);
+
+/**
+	@brief	This function is called by sensor frame source (HAL backend) when discharge time of each sensor is known.
+	@details	It saves values, calibrates the sensors (if calibration is set), calculates sensor state and publishes the frame (::la_readFrame).
+	@param	raw Pointer to discharge times (::HAL_NBR_OF_SENSORS elements, from left).
+*/
+void la_frameComplete( const volatile uint16_t * raw );
+
+/**
+	@brief	This function updates minimum and maximum of each sensor with its current value
 	@param	sensor_array Pointer to buffer structure
-	@return	Return value is byte with binary coded sensor state (last 6 bits, '1' means dark).
 */
 void la_calibrateMinMax( volatile la_sensor_t * sensor_array );
 
 /**
 	@brief	This function decides which colour is under each sensor (1 means dark/black)
+	@details	Raw value is compared with levels prepared at the end of calibration, so there is no division in frame interrupt.
+						Result is the same as comparison of percentage reflectance with ::LA_PERCENTAGE_SWITCHING_LEVEL.
 	@param	sensor_array Pointer to buffer structure
+	@param	previous State of the previous frame (it selects level of each sensor).
 	@return	Return value is byte with binary coded sensor state (last 6 bits, '1' means dark).
 */
-char la_calculateSensorState( volatile la_sensor_t * sensor_array );
+char la_calculateSensorState( volatile la_sensor_t * sensor_array, char previous );
 
 #endif
@@ -0,0 +1,558 @@
+/**
+	@file	zumo_map.c
+	@brief	Weighted graph of maze built during exploration and the shortest-time path planner.
+*/
+#include "zumo_map.h"
+#include <stddef.h>
+
+// Global variables
+HAL_STATE mp_map_t zumoMap;
+
+// Exploration state
+static HAL_STATE uint8_t mp_node;						// Last node (::MP_NONE - lost)
+static HAL_STATE uint8_t mp_heading;				// Current absolute heading
+static HAL_STATE uint8_t mp_exit;						// Heading of leaving the last node
+static HAL_STATE uint8_t mp_atNode;					// 1 - next reaction is done in a node
+static HAL_STATE uint8_t mp_revisit;				// 1 - known crossroad was reached by new edge
+static HAL_STATE uint32_t mp_leaveTime;
+static HAL_STATE uint32_t mp_arriveTime;
+static HAL_STATE uint32_t mp_driveTime;			// Start of straight drive (after the last turn)
+static HAL_STATE int32_t mp_x, mp_y;				// Dead-reckoned position
+static HAL_STATE uint16_t mp_segment[ MP_MAX_SEGMENTS ];	// Straight segments since leaving the last node
+static HAL_STATE uint8_t mp_segments;							// MP_MAX_SEGMENTS + 1 - too many
+static HAL_STATE uint16_t mp_leftTurns;						// Bit i - plain turn after segment i was left
+
+// Exploration policy and goal (kept between runs)
+static HAL_STATE mp_policy_t mp_policy = MP_TREMAUX;
+static HAL_STATE uint8_t mp_goalSet;
+static HAL_STATE int32_t mp_goalX, mp_goalY;
+
+// Unit vector of each heading
+static const int8_t mp_dx[4] = { 1, 0, -1, 0 };
+static const int8_t mp_dy[4] = { 0, 1, 0, -1 };
+
+// Branches in crossroad: relative turn and reaction
+static const uint8_t mp_turn[3] = { 1, 0, 3 };
+static const char mp_letter[3] = { 'L', 'S', 'R' };
+
+// Planner state (static, because stack is too small)
+static HAL_STATE uint32_t mp_dist[ MP_MAX_NODES ];
+static HAL_STATE uint8_t mp_prev[ MP_MAX_NODES ];			// Previous node on the best path
+static HAL_STATE uint8_t mp_in[ MP_MAX_NODES ];				// Heading of arrival on the best path
+static HAL_STATE uint8_t mp_out[ MP_MAX_NODES ];			// Heading of leaving previous node on the best path
+static HAL_STATE uint8_t mp_done[ MP_MAX_NODES ];
+static HAL_STATE uint8_t mp_path[ MP_MAX_NODES ];			// Nodes of the best path, from finish
+
+
+/**
+	@brief	Function adds node without edges.
+	@return	Return value is index of node or ::MP_NONE when map is full.
+*/
+static uint8_t mp_addNode( void ){
+
+	uint8_t i;
+
+	if( zumoMap.nbr_of_nodes >= MP_MAX_NODES ){
+		zumoMap.full = 1;
+		return MP_NONE;
+	}
+	for( i=0; i<4; i++ ) zumoMap.node[ zumoMap.nbr_of_nodes ].edge[i] = MP_NONE;
+	zumoMap.node[ zumoMap.nbr_of_nodes ].crossroad = 0;
+	zumoMap.node[ zumoMap.nbr_of_nodes ].branches = 0;
+	zumoMap.node[ zumoMap.nbr_of_nodes ].x = mp_x;
+	zumoMap.node[ zumoMap.nbr_of_nodes ].y = mp_y;
+	return zumoMap.nbr_of_nodes++;
+}
+
+/**
+	@brief	Function checks if node type is a crossroad.
+*/
+static uint8_t mp_isCrossroad( uint8_t node_type ){
+
+	return node_type == FULL_CROSS || node_type == STRAIGHT_LEFT_CROSS || node_type == STRAIGHT_RIGHT_CROSS || node_type == LEFT_RIGHT_CROSS;
+}
+
+/**
+	@brief	Function looks for known crossroad at current position.
+	@details	Crossroad type seen from another side can be misdetected, so only the arrival branch is checked: it has to be unknown yet.
+	@return	Return value is index of the closest one or ::MP_NONE.
+*/
+static uint8_t mp_findCrossroad( void ){
+
+	uint8_t i, found = MP_NONE;
+	int32_t dx, dy, d, best = MP_MATCH_MS;
+
+	for( i=0; i<zumoMap.nbr_of_nodes; i++ ){
+		if( !zumoMap.node[i].crossroad || zumoMap.node[i].edge[ (mp_heading + 2) & 3 ] != MP_NONE ) continue;
+		dx = zumoMap.node[i].x - mp_x;
+		dy = zumoMap.node[i].y - mp_y;
+		d = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+		if( d < best ){
+			best = d;
+			found = i;
+		}
+	}
+	return found;
+}
+
+/**
+	@brief	Function adds edge from current node, leaving it in ::mp_exit heading and arriving at given node in current heading.
+	@details	Branch with known edge is never overwritten, map is marked inconsistent instead (see ::mp_map_t conflict).
+	@return	Return value is index of edge or ::MP_NONE when map is full or branch is taken.
+*/
+static uint8_t mp_addEdge( uint8_t next, uint32_t time ){
+
+	uint8_t e, in = (mp_heading + 2) & 3;
+	mp_edge_t * edge;
+
+	if( zumoMap.node[ mp_node ].edge[ mp_exit ] != MP_NONE || zumoMap.node[ next ].edge[ in ] != MP_NONE
+		|| (next == mp_node && in == mp_exit) ){
+		zumoMap.conflict = 1;
+		return MP_NONE;
+	}
+	if( zumoMap.nbr_of_edges >= MP_MAX_EDGES ){
+		zumoMap.full = 1;
+		return MP_NONE;
+	}
+	e = zumoMap.nbr_of_edges++;
+	edge = &zumoMap.edge[e];
+	edge->node[0] = mp_node;
+	edge->node[1] = next;
+	edge->heading[0] = mp_exit;
+	edge->heading[1] = mp_heading;
+	edge->time_ms = time;
+	edge->passes = 0;
+	zumoMap.node[ mp_node ].edge[ mp_exit ] = e;
+	zumoMap.node[ next ].edge[ in ] = e;
+	return e;
+}
+
+/**
+	@brief	Function saves segments of the last drive in edge.
+	@param	forward 1 - edge was driven from node[0] to node[1].
+*/
+static void mp_setSegments( mp_edge_t * edge, uint8_t forward ){
+
+	uint8_t i;
+
+	if( mp_segments > MP_MAX_SEGMENTS ){
+		edge->segments = 0;
+		return;
+	}
+	edge->segments = mp_segments;
+	for( i=0; i<mp_segments; i++ ) edge->segment_ms[i] = mp_segment[ forward ? i : mp_segments - 1 - i ];
+
+	// Driven backwards, turns come in reverse order and to the other side.
+	if( forward ){
+		edge->left_turns = mp_leftTurns;
+		return;
+	}
+	edge->left_turns = 0;
+	for( i=0; i+1<mp_segments; i++ ){
+		if( !(mp_leftTurns & (1u << (mp_segments - 2 - i))) ) edge->left_turns |= 1u << i;
+	}
+}
+
+void mp_init( void ){
+
+	zumoMap.nbr_of_nodes = 0;
+	zumoMap.nbr_of_edges = 0;
+	zumoMap.finish = MP_NONE;
+	zumoMap.full = 0;
+	zumoMap.conflict = 0;
+	zumoMap.turn_ms = 0;
+	zumoMap.turns = 0;
+	zumoMap.loops = 0;
+
+	// Zumo leaves start node straight ahead.
+	mp_x = 0;
+	mp_y = 0;
+	mp_node = mp_addNode();
+	mp_heading = 0;
+	mp_exit = 0;
+	mp_atNode = 0;
+	mp_revisit = 0;
+	mp_segments = 0;
+	mp_leftTurns = 0;
+	mp_leaveTime = hal_millis();
+	mp_driveTime = mp_leaveTime;
+}
+
+void mp_arrive( uint8_t node_type ){
+
+	uint32_t time;
+	uint8_t e, next;
+	mp_edge_t * edge;
+
+	if( !mp_isCrossroad( node_type ) && node_type != DEAD_END && node_type != MAZE_END
+		&& node_type != LEFT_TURN && node_type != RIGHT_TURN ) return;
+
+	// Straight drive since the last turn moves position.
+	mp_arriveTime = hal_millis();
+	time = mp_arriveTime - mp_driveTime;
+	mp_x += mp_dx[ mp_heading ] * (int32_t)time;
+	mp_y += mp_dy[ mp_heading ] * (int32_t)time;
+	mp_driveTime = mp_arriveTime;
+	if( mp_segments < MP_MAX_SEGMENTS ) mp_segment[ mp_segments ] = (time > UINT16_MAX) ? UINT16_MAX : (uint16_t)time;
+	if( mp_segments <= MP_MAX_SEGMENTS ) mp_segments++;
+
+	// Plain turn is a part of edge.
+	if( node_type == LEFT_TURN || node_type == RIGHT_TURN ) return;
+
+	mp_atNode = 1;
+	mp_revisit = 0;
+	if( mp_node == MP_NONE ) return;
+
+	time = mp_arriveTime - mp_leaveTime;
+	if( time > UINT16_MAX ) time = UINT16_MAX;
+	e = zumoMap.node[ mp_node ].edge[ mp_exit ];
+
+	// Known edge leads to known node ...
+	if( e != MP_NONE ){
+		uint8_t forward;
+		edge = &zumoMap.edge[e];
+		forward = edge->node[0] == mp_node && edge->heading[0] == mp_exit;
+		if( time < edge->time_ms ){
+			edge->time_ms = time;
+			mp_setSegments( edge, forward );
+		}
+		mp_node = forward ? edge->node[1] : edge->node[0];
+	}
+	// ... new edge leads to known crossroad (loop) ...
+	else if( mp_isCrossroad( node_type ) && (next = mp_findCrossroad()) != MP_NONE ){
+		e = mp_addEdge( next, time );
+		if( e == MP_NONE ){
+			mp_node = MP_NONE;
+			return;
+		}
+		mp_setSegments( &zumoMap.edge[e], 1 );
+		mp_node = next;
+		mp_revisit = 1;
+		zumoMap.loops++;
+	}
+	// ... or to new node.
+	else{
+		next = mp_addNode();
+		e = (next == MP_NONE) ? MP_NONE : mp_addEdge( next, time );
+		if( e == MP_NONE ){
+			mp_node = MP_NONE;
+			return;
+		}
+		zumoMap.node[ next ].crossroad = mp_isCrossroad( node_type );
+		mp_setSegments( &zumoMap.edge[e], 1 );
+		mp_node = next;
+	}
+	zumoMap.edge[e].passes++;
+
+	// Branches seen from arrival heading (the way back is always there).
+	zumoMap.node[ mp_node ].branches |= 1 << ((mp_heading + 2) & 3);
+	if( node_type == FULL_CROSS || node_type == STRAIGHT_LEFT_CROSS || node_type == LEFT_RIGHT_CROSS ) zumoMap.node[ mp_node ].branches |= 1 << ((mp_heading + 1) & 3);
+	if( node_type == FULL_CROSS || node_type == STRAIGHT_LEFT_CROSS || node_type == STRAIGHT_RIGHT_CROSS ) zumoMap.node[ mp_node ].branches |= 1 << mp_heading;
+	if( node_type == FULL_CROSS || node_type == STRAIGHT_RIGHT_CROSS || node_type == LEFT_RIGHT_CROSS ) zumoMap.node[ mp_node ].branches |= 1 << ((mp_heading + 3) & 3);
+
+	// Known node corrects position error.
+	mp_x = zumoMap.node[ mp_node ].x;
+	mp_y = zumoMap.node[ mp_node ].y;
+
+	if( node_type == MAZE_END ) zumoMap.finish = mp_node;
+}
+
+void mp_leave( char reaction ){
+
+	uint8_t turn;
+
+	switch( reaction ){
+		case 'S': case 'F':	turn = 0;	break;
+		case 'L': case 'l':	turn = 1;	break;
+		case 'T':						turn = 2;	break;
+		case 'R': case 'r':	turn = 3;	break;
+		default:	return;
+	}
+	mp_heading = (mp_heading + turn) & 3;
+	mp_driveTime = hal_millis();
+
+	// Plain turns only change heading (and their side is kept for replay), reactions in nodes start new edge.
+	if( reaction == 'l' && mp_segments > 0 && mp_segments <= MP_MAX_SEGMENTS ) mp_leftTurns |= 1u << (mp_segments - 1);
+	if( reaction == 'l' || reaction == 'r' || !mp_atNode ) return;
+	mp_atNode = 0;
+	mp_segments = 0;
+	mp_leftTurns = 0;
+	mp_leaveTime = mp_driveTime;
+	mp_exit = mp_heading;
+	if( turn == 1 || turn == 3 ){
+		zumoMap.turn_ms += mp_leaveTime - mp_arriveTime;
+		zumoMap.turns++;
+	}
+}
+
+/**
+	@brief	Left-hand rule is done by ::zm_nodeReaction itself.
+*/
+static char mp_leftHand( const uint8_t * exists ){
+
+	(void)exists;
+	return 0;
+}
+
+static char mp_rightHand( const uint8_t * exists ){
+
+	int8_t i;
+
+	for( i=2; i>=0; i-- ){
+		if( exists[i] ) return mp_letter[i];
+	}
+	return 0;
+}
+
+/**
+	@brief	Function chooses branch with Tremaux rule.
+	@param	exists Existence of L, S and R branch.
+	@param	order Branches (0 - L, 1 - S, 2 - R) in order of preference.
+*/
+static char mp_tremauxOrder( const uint8_t * exists, const uint8_t * order ){
+
+	uint8_t i, b, e;
+	const mp_node_t * node;
+
+	if( mp_node == MP_NONE ) return 0;
+	node = &zumoMap.node[ mp_node ];
+
+	// Loop closed - go back, so the new edge is done.
+	if( mp_revisit ) return 'T';
+
+	// Unexplored branch ...
+	for( i=0; i<3; i++ ){
+		b = order[i];
+		if( exists[b] && node->edge[ (mp_heading + mp_turn[b]) & 3 ] == MP_NONE ) return mp_letter[b];
+	}
+	// ... or the way back, if it was driven once ...
+	e = node->edge[ (mp_heading + 2) & 3 ];
+	if( e != MP_NONE && zumoMap.edge[e].passes < 2 ) return 'T';
+	// ... or any branch driven once.
+	for( i=0; i<3; i++ ){
+		b = order[i];
+		e = node->edge[ (mp_heading + mp_turn[b]) & 3 ];
+		if( exists[b] && e != MP_NONE && zumoMap.edge[e].passes < 2 ) return mp_letter[b];
+	}
+	return 0;
+}
+
+static char mp_tremaux( const uint8_t * exists ){
+
+	static const uint8_t order[3] = { 0, 1, 2 };
+
+	return mp_tremauxOrder( exists, order );
+}
+
+static char mp_floodFill( const uint8_t * exists ){
+
+	uint8_t order[3] = { 0, 1, 2 };
+	int32_t progress[3];
+	uint8_t i, j, h, b;
+
+	if( !mp_goalSet ) return mp_tremaux( exists );
+
+	// Progress towards goal along each branch, sorted without changing order of equal ones
+	for( i=0; i<3; i++ ){
+		h = (mp_heading + mp_turn[i]) & 3;
+		progress[i] = mp_dx[h] * (mp_goalX - mp_x) + mp_dy[h] * (mp_goalY - mp_y);
+	}
+	for( i=1; i<3; i++ ){
+		for( j=i; j>0 && progress[ order[j] ] > progress[ order[j-1] ]; j-- ){
+			b = order[j];
+			order[j] = order[j-1];
+			order[j-1] = b;
+		}
+	}
+	return mp_tremauxOrder( exists, order );
+}
+
+// Exploration policies in order of ::mp_policy_t
+static const struct{
+	const char * name;
+	char (* choose)( const uint8_t * exists );
+} mp_policies[ MP_NBR_OF_POLICIES ] = {
+	{ "left-hand",	mp_leftHand },
+	{ "right-hand",	mp_rightHand },
+	{ "tremaux",		mp_tremaux },
+	{ "flood-fill",	mp_floodFill }
+};
+
+void mp_setPolicy( mp_policy_t policy ){
+
+	if( policy < MP_NBR_OF_POLICIES ) mp_policy = policy;
+}
+
+mp_policy_t mp_getPolicy( void ){
+
+	return mp_policy;
+}
+
+const char * mp_policyName( mp_policy_t policy ){
+
+	return (policy < MP_NBR_OF_POLICIES) ? mp_policies[ policy ].name : NULL;
+}
+
+void mp_setGoal( int32_t x, int32_t y ){
+
+	mp_goalX = x;
+	mp_goalY = y;
+	mp_goalSet = 1;
+}
+
+char mp_choose( uint8_t node_type ){
+
+	uint8_t exists[3];
+
+	if( !mp_isCrossroad( node_type ) ) return 0;
+
+	exists[0] = (node_type == FULL_CROSS || node_type == STRAIGHT_LEFT_CROSS || node_type == LEFT_RIGHT_CROSS);
+	exists[1] = (node_type == FULL_CROSS || node_type == STRAIGHT_LEFT_CROSS || node_type == STRAIGHT_RIGHT_CROSS);
+	exists[2] = (node_type == FULL_CROSS || node_type == STRAIGHT_RIGHT_CROSS || node_type == LEFT_RIGHT_CROSS);
+
+	return mp_policies[ mp_policy ].choose( exists );
+}
+
+uint8_t mp_lost( void ){
+
+	return mp_node == MP_NONE && mp_policy != MP_LEFT_HAND && mp_policy != MP_RIGHT_HAND;
+}
+
+/**
+	@brief	Function returns type of node as it is seen when Zumo arrives in given heading.
+*/
+static uint8_t mp_nodeType( uint8_t v, uint8_t in ){
+
+	static const uint8_t mp_types[8] = {
+		// no branch, L, S, L+S, R, L+R, S+R, L+S+R
+		DEAD_END, LEFT_TURN, DEAD_END, STRAIGHT_LEFT_CROSS, RIGHT_TURN, LEFT_RIGHT_CROSS, STRAIGHT_RIGHT_CROSS, FULL_CROSS
+	};
+	uint8_t branches = zumoMap.node[v].branches;
+	uint8_t seen = 0, i;
+
+	if( v == zumoMap.finish ) return MAZE_END;
+	for( i=0; i<3; i++ ){
+		if( branches & (1 << ((in + mp_turn[i]) & 3)) ) seen |= 1 << i;
+	}
+	return mp_types[ seen ];
+}
+
+/**
+	@brief	Function appends segments of edge to profile with expected node type after each one.
+	@param	u Node where edge is left.
+	@param	h Heading of leaving.
+	@return	Return value is 0 when segments are unknown or profile is full.
+*/
+static uint8_t mp_addProfile( mp_profile_t * profile, uint8_t u, uint8_t h ){
+
+	const mp_edge_t * edge = &zumoMap.edge[ zumoMap.node[u].edge[h] ];
+	uint8_t forward = edge->node[0] == u && edge->heading[0] == h;
+	uint8_t n = edge->segments;
+	uint8_t left;
+	uint16_t ms;
+	uint8_t i;
+
+	if( n == 0 || profile->length + n > MP_MAX_PROFILE ) return 0;
+	for( i=0; i<n; i++ ){
+		ms = edge->segment_ms[ forward ? i : n - 1 - i ];
+		// The last one is replaced by node at the end of edge.
+		left = (i + 1 < n) && (forward ? (edge->left_turns >> i) & 1 : !((edge->left_turns >> (n - 2 - i)) & 1));
+		profile->node_type[ profile->length ] = left ? LEFT_TURN : RIGHT_TURN;
+		profile->segment[ profile->length++ ] = (ms < MP_PROFILE_NODE) ? ms : MP_PROFILE_NODE - 1;
+	}
+	profile->segment[ profile->length - 1 ] |= MP_PROFILE_NODE;
+	profile->node_type[ profile->length - 1 ] = forward ? mp_nodeType( edge->node[1], edge->heading[1] ) : mp_nodeType( edge->node[0], (edge->heading[0] + 2) & 3 );
+	return 1;
+}
+
+uint8_t mp_plan( NodeArr_t * route, mp_profile_t * profile ){
+
+	static const char mp_reaction[4] = { 'S', 'L', 'T', 'R' };
+	uint32_t turn_ms = zumoMap.turns ? zumoMap.turn_ms / zumoMap.turns : MP_DEFAULT_TURN_MS;
+	uint8_t u, v, h, i, e;
+	uint8_t n = zumoMap.nbr_of_nodes;
+	uint16_t length;
+
+	profile->length = 0;
+	if( zumoMap.full || zumoMap.conflict || zumoMap.finish == MP_NONE ) return 0;
+
+	for( i=0; i<n; i++ ){
+		mp_dist[i] = UINT32_MAX;
+		mp_done[i] = 0;
+	}
+	mp_dist[0] = 0;
+	mp_in[0] = 0;
+
+	// Dijkstra (simple O(n^2) version, no heap)
+	while( 1 ){
+
+		// The closest node not done yet
+		u = MP_NONE;
+		for( i=0; i<n; i++ ){
+			if( !mp_done[i] && mp_dist[i] != UINT32_MAX && (u == MP_NONE || mp_dist[i] < mp_dist[u]) ) u = i;
+		}
+		if( u == MP_NONE || u == zumoMap.finish ) break;
+		mp_done[u] = 1;
+
+		for( h=0; h<4; h++ ){
+
+			const mp_edge_t * edge;
+			uint32_t cost;
+			uint8_t in;
+
+			e = zumoMap.node[u].edge[h];
+			if( e == MP_NONE ) continue;
+			edge = &zumoMap.edge[e];
+
+			// Drive along the edge in either direction
+			if( edge->node[0] == u && edge->heading[0] == h ){
+				v = edge->node[1];
+				in = edge->heading[1];
+			}
+			else{
+				v = edge->node[0];
+				in = (edge->heading[0] + 2) & 3;
+			}
+
+			// Turn in node (start node is left straight ahead)
+			cost = mp_dist[u] + edge->time_ms;
+			if( u != 0 ){
+				uint8_t turn = (h - mp_in[u]) & 3;
+				if( turn == 1 || turn == 3 ) cost += turn_ms;
+				else if( turn == 2 ) cost += 2 * turn_ms;
+			}
+
+			if( !mp_done[v] && cost < mp_dist[v] ){
+				mp_dist[v] = cost;
+				mp_prev[v] = u;
+				mp_in[v] = in;
+				mp_out[v] = h;
+			}
+		}
+	}
+	if( mp_dist[ zumoMap.finish ] == UINT32_MAX ) return 0;
+
+	// Nodes of path from finish back to start ...
+	length = 0;
+	for( v = zumoMap.finish; v != 0; v = mp_prev[v] ) mp_path[ length++ ] = v;
+
+	// ... segments of each edge on the way (start node closes the path) ...
+	mp_path[ length ] = 0;
+	for( i=length; i>0; i-- ){
+		if( !mp_addProfile( profile, mp_path[i], mp_out[ mp_path[i-1] ] ) ){
+			profile->length = 0;
+			break;
+		}
+	}
+
+	// ... and reactions from start to finish. Reaction in node is turn from arrival heading to heading of leaving.
+	// Finish in start node gives empty path (length 0), so the counter is not decremented below zero.
+	zm_clearArray( route );
+	for( ; length > 1; length-- ){
+		v = mp_path[ length-2 ];
+		u = mp_path[ length-1 ];
+		zm_addReaction( mp_reaction[ (mp_out[v] - mp_in[u]) & 3 ], route );
+	}
+	zm_addReaction( 'F', route );
+	return 1;
+}
@@ -0,0 +1,200 @@
+/**
+	@file	zumo_map.h
+	@brief	Weighted graph of maze built during exploration and the shortest-time path planner.
+	@details	Junctions, dead ends, start and finish are graph nodes. Line between two nodes (it can contain plain turns) is an edge.
+						Each edge keeps heading at both ends and the shortest measured drive time.
+						Headings are absolute quarter turns counted counter-clockwise from the start direction (0 - start, 1 - left, 2 - back, 3 - right).
+						Position is dead-reckoned from drive time between turns (unit: millisecond of drive at exploration speed).
+						Zumo comes back to a known node when it drives along a known edge, or when it reaches a crossroad
+						closer than ::MP_MATCH_MS to a known crossroad (loop in the maze).
+						Position is snapped to every known node reached.
+*/
+#ifndef ZUMO_MAP_H_
+#define ZUMO_MAP_H_
+#include <stdint.h>
+#include "zumo_hal.h"
+#include "zumo_maze.h"
+
+/**
+	@brief	Maximum number of graph nodes and edges. When the maze does not fit, ::mp_plan keeps left-hand route.
+	@details	Every crossroad, dead end and finish takes one node, and every line between them one edge.
+						Exploration with Tremaux rule is stopped when its map is full (see ::mp_lost).
+						Random mazes of zumo_mazegen (10% loops) fit up to about 16 x 16 grid points, from about 300 grid points on they may not fit.
+*/
+#define MP_MAX_NODES 128
+#define MP_MAX_EDGES 192
+
+/**
+	@brief	Marker of missing node or edge.
+*/
+#define MP_NONE 0xFF
+
+/**
+	@brief	Time of L or R turn assumed until first one is measured [ms].
+*/
+#define MP_DEFAULT_TURN_MS 400
+
+/**
+	@brief	Largest distance between dead-reckoned position and known crossroad to take them as the same one [ms of drive].
+	@details	It should be about one third of the shortest edge.
+*/
+#define MP_MATCH_MS 250
+
+/**
+	@brief	Maximum number of straight segments (lines between plain turns) of one edge kept for speed profile.
+	@details	Edge with more segments has unknown ones, then route through it has no profile.
+*/
+#define MP_MAX_SEGMENTS 10
+
+/**
+	@brief	Maximum number of segments of planned route (::mp_profile_t).
+*/
+#define MP_MAX_PROFILE 128
+
+/**
+	@brief	Flag of profile segment which ends in crossroad or finish (not in plain turn).
+*/
+#define MP_PROFILE_NODE 0x8000
+
+/**
+	@brief	Exploration policies (see ::mp_setPolicy).
+*/
+typedef enum{
+	MP_LEFT_HAND,							/**< Left-hand rule of ::zm_nodeReaction, map is only recorded */
+	MP_RIGHT_HAND,						/**< Right-hand rule */
+	MP_TREMAUX,								/**< Tremaux rule, the same as left-hand rule until loop is found (default) */
+	MP_FLOOD_FILL,						/**< Tremaux rule which takes branch leading towards goal first (see ::mp_setGoal) */
+	MP_NBR_OF_POLICIES
+} mp_policy_t;
+
+/**
+	@brief	Line between two nodes.
+*/
+typedef struct{
+	uint8_t node[2];					/**< Ends of edge */
+	uint8_t heading[2];				/**< Heading when leaving node[0] and heading when arriving at node[1] */
+	uint16_t time_ms;					/**< Shortest drive time from one end to another */
+	uint8_t passes;						/**< Number of drives along the edge (both directions) */
+	uint8_t segments;					/**< Number of straight segments from node[0] to node[1] (0 - unknown) */
+	uint16_t segment_ms[ MP_MAX_SEGMENTS ];		/**< Drive time of each segment of the shortest drive */
+	uint16_t left_turns;			/**< Bit i - plain turn after segment i is left (from node[0] to node[1]), otherwise right */
+} mp_edge_t;
+
+/**
+	@brief	Node of graph.
+*/
+typedef struct{
+	uint8_t edge[4];					/**< Edge leaving the node in each absolute heading (::MP_NONE - not known) */
+	uint8_t crossroad;				/**< 1 - node is a crossroad (it can be reached from many sides) */
+	uint8_t branches;					/**< Bit h - line leaves the node in absolute heading h (seen in ::mp_arrive) */
+	int32_t x, y;							/**< Position [ms of drive], heading 0 is +x, heading 1 is +y */
+} mp_node_t;
+
+/**
+	@brief	Maze graph.
+*/
+typedef struct{
+	mp_node_t node[ MP_MAX_NODES ];
+	mp_edge_t edge[ MP_MAX_EDGES ];
+	uint8_t nbr_of_nodes;
+	uint8_t nbr_of_edges;
+	uint8_t finish;						/**< Finish node (::MP_NONE - not reached) */
+	uint8_t full;							/**< 1 - some node or edge did not fit */
+	uint8_t conflict;					/**< 1 - new edge came to branch with known edge (position error), map is not valid */
+	uint32_t turn_ms;					/**< Sum of measured L and R turn times */
+	uint16_t turns;						/**< Number of measured turns */
+	uint16_t loops;						/**< Number of known crossroads reached by new edge */
+} mp_map_t;
+
+/**
+	@brief	Straight segments of planned route, one for each ::zm_driveToNode of replay.
+*/
+typedef struct{
+	uint16_t segment[ MP_MAX_PROFILE ];		/**< Drive time [ms at exploration speed] including ::zm_checkNode, ::MP_PROFILE_NODE flag */
+	uint8_t node_type[ MP_MAX_PROFILE ];	/**< Expected type of node at the end of each segment (::Node_type) */
+	uint8_t length;												/**< Number of segments (0 - no profile) */
+} mp_profile_t;
+
+/**
+	@brief	Map built by the last exploration.
+*/
+extern HAL_STATE mp_map_t zumoMap;
+
+
+/**
+	@brief	Function clears map and puts Zumo at start node (heading 0). Call it just before first ::zm_driveToNode.
+*/
+void mp_init( void );
+
+/**
+	@brief	Function registers arrival at a node. Call it just after ::zm_checkNode.
+	@details	Plain turns (::LEFT_TURN, ::RIGHT_TURN) are parts of edges and they are skipped here.
+	@param	node_type Type of node enumerated in ::Node_type.
+*/
+void mp_arrive( uint8_t node_type );
+
+/**
+	@brief	Function registers reaction done in node. Call it just after ::zm_nodeReaction.
+	@param	reaction Reaction character (see ::zm_nodeReaction), also 'l' and 'r'.
+*/
+void mp_leave( char reaction );
+
+/**
+	@brief	Function selects exploration policy used by ::mp_choose. It is kept by ::mp_init.
+	@param	policy Policy enumerated in ::mp_policy_t.
+*/
+void mp_setPolicy( mp_policy_t policy );
+
+/**
+	@brief	Function returns selected exploration policy.
+*/
+mp_policy_t mp_getPolicy( void );
+
+/**
+	@brief	Function returns short name of exploration policy (e.g. "tremaux").
+	@return	Return value is the name or NULL when policy is not known.
+*/
+const char * mp_policyName( mp_policy_t policy );
+
+/**
+	@brief	Function sets goal for ::MP_FLOOD_FILL policy. It is kept by ::mp_init.
+	@param	x,y Position of finish relative to start [ms of drive], heading 0 is +x, heading 1 (left) is +y.
+*/
+void mp_setGoal( int32_t x, int32_t y );
+
+/**
+	@brief	Function chooses reaction in crossroad with selected exploration policy.
+	@details	Tremaux rule drives every edge at most twice:
+						<ul>
+							<li> when known crossroad is reached by new edge, Zumo turns back,
+							<li> otherwise it takes unexplored branch (first of L, S, R),
+							<li> otherwise branch driven once, the one it came from first.
+						</ul>
+						As long as no loop is found it gives the same reactions as left-hand rule.
+						Flood fill of open grid gives Manhattan distance to goal, so ::MP_FLOOD_FILL is Tremaux rule which orders branches
+						by progress towards goal (L, S, R order is kept only for equal ones).
+						Call it after ::mp_arrive and pass reaction to ::zm_guidedNodeReaction.
+	@param	node_type Type of node enumerated in ::Node_type.
+	@return	Return value is L, S, R or T, or 0 when node is not a crossroad, map is lost or policy is ::MP_LEFT_HAND (use ::zm_nodeReaction then).
+*/
+char mp_choose( uint8_t node_type );
+
+/**
+	@brief	Function checks if exploration policy lost the map it needs (node did not fit, see ::MP_MAX_NODES, or map conflict).
+	@details	Tremaux rule without map falls back to left-hand rule, which never ends in maze with loops,
+						so exploration should be stopped then. Left-hand and right-hand rules do not need the map.
+	@return	Return value is 1 when the map is lost.
+*/
+uint8_t mp_lost( void );
+
+/**
+	@brief	Function finds the shortest-time path from start to finish (Dijkstra) and writes its reactions.
+	@details	Cost of path is sum of edge times and time of each L or R turn on the way (mean of measured turns).
+	@param[out]	route Node buffer for ::zm_strictNodeReaction. It is not changed when there is no plan.
+	@param[out]	profile Segments of the route for speed profile and expected type of node after each one
+						(length 0 when some edge has unknown segments or there is no plan).
+	@return	Return value is 1 when route was written, 0 when finish was not reached or map is not complete.
+*/
+uint8_t mp_plan( NodeArr_t * route, mp_profile_t * profile );
+
+#endif
@@ -3,23 +3,106 @@
 	@brief	Maze solver library prepared for Freescale KL46Z board and Pololu Zumo Shield
 */
 #include "zumo_maze.h"
-#include "MKL46Z4.h"
+#include "zumo_hal.h"
 #include "motorDriver.h"
 #include "zumo_ledArray.h"
+#include "zumo_pid.h"
 #include <string.h>
 
 // Global variables
-NodeArr_t nodeArr;
-NodeArr_t optimizedNodeArr;
+HAL_STATE NodeArr_t nodeArr;
+HAL_STATE NodeArr_t optimizedNodeArr;
+
+/**
+	@brief	Line following gain schedule (see ::pid_selectGains), error is line position minus ::LA_POSITION_CENTER.
+	@details	Coefficients are obtained experimentally (500 units of position is half of sensor spacing). Faster Zumo needs stronger and more damped steering.
+*/
+static const pid_gains_t zm_gains[] = {
+	//	speed	Kp								Ki		Kd								derivative filter
+	{		40,		15*PID_ONE/500,		1,		1*PID_ONE/500,		PID_ONE			},
+	{		60,		23*PID_ONE/500,		1,		2*PID_ONE/500,		PID_ONE/2		},
+	{		100,	30*PID_ONE/500,		1,		3*PID_ONE/500,		PID_ONE/2		}
+};
+
+/**
+	@brief	State of line following control loop shared by ::zm_driveToNode and ::zm_controlTick.
+*/
+static HAL_STATE struct{
+	uint32_t speed;								/**< Current speed [1/256] */
+	uint32_t end_speed;						/**< Speed at the end of profile [1/256] */
+	uint32_t top_speed;						/**< Top speed of profile [1/256] */
+	uint32_t travelled;						/**< Sum of speed of each tick */
+	uint32_t distance;						/**< Braking point (0 - constant speed) */
+	uint8_t pass;									/**< 1 - keep driving straight in node (see ::zm_passNode) */
+	pid_ctrl_t pid;
+	zm_detector_t detector;				/**< Node detector, its event tells how node was reached */
+	uint32_t frame;								/**< Sequence number of the last frame given to detector */
+	volatile uint8_t node;				/**< 1 - node reached, tick does nothing */
+} zm_control = { 0, 0, 0, 0, 0, 0, { 0 }, { 0 }, 0, 1 };
+
+/**
+	@brief	Speed change in one control tick [1/256 of speed unit].
+*/
+#define ZM_ACCELERATION_STEP ( (uint32_t)ZM_ACCELERATION * 256 / ZM_CONTROL_HZ )
+
+/**
+	@brief	Remaining distance long enough to brake from full speed. Longer one is cut, so braking test does not overflow.
+*/
+#define ZM_BRAKE_RANGE ( (100ul*256) * (100ul*256) / (2 * ZM_ACCELERATION_STEP) )
 
 
 void zm_clearArray( NodeArr_t * node_array ){
 
 	uint16_t i;
-	for(i=0; i<MAX_NBR_OF_NODES; i++)	*(node_array->tab+i) = 0; // Array reset
-	node_array->max_index = 0;
+	for(i=0; i<MAX_NBR_OF_NODES/4; i++)	*(node_array->tab+i) = 0; // Array reset
+	node_array->length = 0;
+	node_array->cursor = 0;
+	node_array->finished = 0;
+	node_array->overflow = 0;
+}
+
+
+void zm_detectorInit( zm_detector_t * detector ){
+	
+	detector->event = 0;
+	detector->candidate = 0;
+	detector->count = 0;
+	detector->seen = 0;
+}
+
+/**
+	@brief	Function classifies one frame for node detector.
+*/
+static uint8_t zm_frameEvent( char state ){
+	
+	if( state == FINISH ) return ZM_EVENT_FINISH;
+	if( state == EMPTY ) return ZM_EVENT_END;
+	// Branch is seen also with one more sensor on dark (e.g. 111110), so only its sensors are tested.
+	if( (state & ALL) == ALL ) return ZM_EVENT_LEFT | ZM_EVENT_RIGHT;
+	if( (state & LEFT) == LEFT ) return ZM_EVENT_LEFT;
+	if( (state & RIGHT) == RIGHT ) return ZM_EVENT_RIGHT;
+	
+	// Outer sensor on dark is a branch coming under array (or passing away), it is not clear yet.
+	return (state & 0x21) ? 0 : ZM_EVENT_LINE;
 }
 
+uint8_t zm_detectorStep( zm_detector_t * detector, char state ){
+	
+	uint8_t event = zm_frameEvent( state );
+	
+	// Count frames in a row with the same event ...
+	if( event != detector->candidate ){
+		detector->candidate = event;
+		detector->count = 0;
+	}
+	if( detector->count < ZM_DEBOUNCE_FRAMES ) detector->count++;
+	
+	// ... and confirm it when there is enough of them.
+	if( detector->count < ZM_DEBOUNCE_FRAMES || event == 0 || event == detector->event ) return 0;
+	detector->event = event;
+	detector->seen |= event;
+	return event;
+}
 
 void zm_calibration( uint8_t speed ){
 	
@@ -30,7 +113,7 @@ void zm_calibration( uint8_t speed ){
 	// Wait some time
 	_delay_ms( 2000 );
 	
-	while( la_getSensorState() != 0x0C ); // Stop when the line is under LED array (2 center sensors)
+	while( la_getSensorState() != 0x0C ) la_updateCal(); // Stop when the line is under LED array (2 center sensors)
 	driveStop();
 	// Disable the calibration
 	la_stopCal();
@@ -38,123 +121,143 @@ void zm_calibration( uint8_t speed ){
 
 void zm_driveToNode( uint8_t speed ){
 	
-	// Coefficients are obtained experimentally
-	const int16_t Kp = 15;
-	const int16_t Ki = 256;
-	const int16_t Kd = 1;
+	zm_driveProfiled( speed, speed, 0, 0 );
+}
+
+void zm_driveProfiled( uint8_t speed, uint8_t top_speed, uint32_t distance, uint8_t pass ){
+	
+	// Prepare speed profile (braking ends at ::ZM_BRAKE_POINT of distance)...
+	zm_control.speed = (uint32_t)speed << 8;
+	zm_control.end_speed = zm_control.speed;
+	zm_control.top_speed = (top_speed > speed) ? (uint32_t)top_speed << 8 : zm_control.speed;
+	zm_control.travelled = 0;
+	zm_control.distance = distance * (256ul * ZM_CONTROL_HZ / 1000) / 100 * ZM_BRAKE_POINT;
+	zm_control.pass = pass;
+	
+	// ... PID controller and node detector
+	pid_init( &zm_control.pid, pid_selectGains( zm_gains, sizeof( zm_gains ) / sizeof( zm_gains[0] ), speed ), -100, 100 );
+	zm_detectorInit( &zm_control.detector );
+	
+	// Drive...
+	driveForward(speed);
+	la_getSensorState();		// Zumo could be moved since the last frame, so the first tick needs fresh one.
+	zm_control.frame = la_peekFrameNumber() - 1;
+	zm_control.node = 0;
+	hal_controlStart( ZM_CONTROL_HZ );
+	
+	// until you reach the node.
+	while( !zm_control.node ) hal_sensorSync();
+	
+	// If you are near the node stop the engines (tick has done it already, unless node is passed).
+	hal_controlStop();
+	if( !pass ) driveStop();
+}
+
+/**
+	@brief	Function makes one step of speed profile.
+	@details	Zumo accelerates up to top speed as long as it can still brake to the end speed before braking point (v^2 - v_end^2 < 2*a*s).
+*/
+static void zm_profileStep( void ){
+	
+	uint32_t v = zm_control.speed;
+	uint32_t remaining = (zm_control.travelled < zm_control.distance) ? zm_control.distance - zm_control.travelled : 0;
+	
+	if( remaining > ZM_BRAKE_RANGE ) remaining = ZM_BRAKE_RANGE;
+	
+	if( v*v - zm_control.end_speed*zm_control.end_speed >= 2 * ZM_ACCELERATION_STEP * remaining ){
+		v = (v > zm_control.end_speed + ZM_ACCELERATION_STEP) ? v - ZM_ACCELERATION_STEP : zm_control.end_speed;
+	}
+	else{
+		v = (v + ZM_ACCELERATION_STEP < zm_control.top_speed) ? v + ZM_ACCELERATION_STEP : zm_control.top_speed;
+	}
 	
+	zm_control.speed = v;
+	zm_control.travelled += v;
+	zm_control.pid.gains = pid_selectGains( zm_gains, sizeof( zm_gains ) / sizeof( zm_gains[0] ), (uint8_t)(v >> 8) );
+}
+
+void zm_controlTick( void ){
 	
-	// Prepare PID variables 
-	int16_t integral = 0;
-	int16_t derivative = 0;
-	int16_t previous_error = 0;
+	la_frame_t frame;
 	int16_t error = 0;
 	int16_t output = 0;
 	int16_t vleft = 0;
 	int16_t vright = 0;
 	
-	// Drive...
-	driveForward(speed);
+	if( zm_control.node ) return;
 	
-	// until you reach the node.
-	while( !NODE ){
-		
-		// Get error value
-		switch( la_getSensorState() ){
-			
-			case 0x10:	error = -3;	break;	// Line under left side of array
-			case 0x18:	error = -2;	break;
-			case 0x08:	error = -1;	break;
-			case 0x0C:	error = 0;	break;	// Line under center (no error)
-			case 0x04:	error = 1;	break;
-			case 0x06:	error = 2;	break;
-			case 0x02:	error = 3;	break;	// Line under right side
-			
-			default:		error = 0;	break;			
+	// New frame goes to node detector. Stop at once (or go straight) when node is confirmed, foreground code is only waiting for this flag.
+	if( la_readFrame( &frame ) != zm_control.frame ){
+		zm_control.frame = frame.seq;
+		if( zm_detectorStep( &zm_control.detector, frame.state ) & ZM_EVENT_NODE ){
+			if( zm_control.pass ) driveForward( zm_control.speed >> 8 );
+			else driveStop();
+			zm_control.node = 1;
+			return;
 		}
-		
-		integral += error;
-		derivative = error - previous_error;
-		previous_error = error;
-		
-		// PID output value
-		output = error*Kp + integral/Ki + derivative*Kd;
-		
-		vleft = speed + output;
-		vright = speed - output;
-		
-		// Normalization (motorDriver library has been changed a little and there is not checking the values inside it)
-		if( vleft > 100 ) vleft = 100;
-		if( vleft < 0 ) vleft = 0;
-		if( vright > 100 ) vright = 100;
-		if( vright < 0 ) vright = 0;
-		
-		driveForwardLeftTrack( vleft );
-		driveForwardRightTrack( vright );
-		
-// 		PID controller (source: http://en.wikipedia.org/wiki/PID_controller):	
-//		previous_error = 0
-//		integral = 0
-//		start:
-//			error = setpoint - measured_value
-//			integral = integral + error*dt
-//			derivative = (error - previous_error)/dt
-//			output = Kp*error + Ki*integral + Kd*derivative
-//			previous_error = error
-//			wait(dt)
-//			goto start
-
+		la_trackFrame( &frame );		// line followed straight keeps calibration up to date
 	}
-	// If you are near the node stop the engines.
-	driveStop();
+		
+	if( zm_control.distance != 0 ) zm_profileStep();
+	
+	// Line on the right side of array gives positive error.
+	error = (int16_t)la_framePosition( &frame ) - LA_POSITION_CENTER;
+	
+	// PID output value
+	output = (int16_t)pid_update( &zm_control.pid, error );
+	
+	vleft = (int16_t)(zm_control.speed >> 8) + output;
+	vright = (int16_t)(zm_control.speed >> 8) - output;
+	
+	// Normalization (motorDriver library has been changed a little and there is not checking the values inside it)
+	if( vleft > 100 ) vleft = 100;
+	if( vleft < 0 ) vleft = 0;
+	if( vright > 100 ) vright = 100;
+	if( vright < 0 ) vright = 0;
+	
+	driveForwardLeftTrack( vleft );
+	driveForwardRightTrack( vright );
 }
 
 
 uint8_t zm_checkNode( uint8_t speed ){
 
-	uint8_t leftAvailable = 0;
-	uint8_t rightAvailable = 0;
+	zm_detector_t detector;
 	uint16_t delay_time = 100;	
-	char new_photo;
+	uint8_t left, right, straight;
 	
 	// White board means there is end of path. So return it.
-	if( la_getSensorState() == EMPTY ) return DEAD_END;
+	if( zm_control.detector.event == ZM_EVENT_END ) return DEAD_END;
 	// Special sign (101101) means end of maze.
-	else if( la_getSensorState() == FINISH ) return MAZE_END;
+	else if( zm_control.detector.event == ZM_EVENT_FINISH ) return MAZE_END;
 	
-	// Drive through the intersection until you reach...
+	// Drive through the intersection until detector confirms line or white board ahead. It remembers branches on the way.
 	driveForward( speed );
-	
-	while(	la_getSensorState() != EMPTY 			// ... white board.
-			&&	la_getSensorState() != CENTER			// ... line under 2 center sensors
-			&&	la_getSensorState() != 0x04				// ... line under one of center sensors
-			&&	la_getSensorState() != 0x08 ){		// ... line under one of center sensors
-					
-		if( (la_getSensorState() & LEFT) == LEFT ) leftAvailable = 1;				// If you see line on the left, set 'left' flag.
-		if( (la_getSensorState() & RIGHT) == RIGHT ) rightAvailable = 1;		// If you see line on the right, set 'right' flag.
-	}
+	zm_detectorInit( &detector );
+	detector.seen = zm_control.detector.seen;
+	while( !(zm_detectorStep( &detector, la_waitSensorState() ) & (ZM_EVENT_LINE | ZM_EVENT_END)) );
+	left = (detector.seen & ZM_EVENT_LEFT) != 0;
+	right = (detector.seen & ZM_EVENT_RIGHT) != 0;
 	
 	// Pass the node to get right position to turn.
 	_delay_ms( delay_time );
 	
-	// Make a 'photo'
-	new_photo = la_getSensorState();
-	// If there is a line under one sensor that means there is a route.
-	if( new_photo == 0x04 || new_photo == 0x08 ) new_photo = CENTER;		
+	// Make a 'photo' (any line ahead means there is a route).
+	straight = la_getSensorState() != EMPTY;
 
 	// Stop the engines.
 	driveStop();
 	
 	// Decide which type of node you passed.
-	if( new_photo == EMPTY ){
-		if( leftAvailable && rightAvailable ) return LEFT_RIGHT_CROSS;
-		else if( leftAvailable ) return LEFT_TURN;
-		else if( rightAvailable ) return RIGHT_TURN;
+	if( !straight ){
+		if( left && right ) return LEFT_RIGHT_CROSS;
+		else if( left ) return LEFT_TURN;
+		else if( right ) return RIGHT_TURN;
 	}
 	else{    //center
-		if( leftAvailable && rightAvailable ) return FULL_CROSS;
-		else if( leftAvailable ) return STRAIGHT_LEFT_CROSS;
-		else if( rightAvailable ) return STRAIGHT_RIGHT_CROSS;
+		if( left && right ) return FULL_CROSS;
+		else if( left ) return STRAIGHT_LEFT_CROSS;
+		else if( right ) return STRAIGHT_RIGHT_CROSS;
 	}
 	
 	// 'Fuse'
@@ -163,18 +266,19 @@ uint8_t zm_checkNode( uint8_t speed ){
 
 char zm_nodeReaction( uint8_t node_type, uint8_t speed ){
 	
-	char reaction;
+	char reaction = 0;
 	
 	// If you get to the end ...
 	if( node_type == MAZE_END ){
 		reaction = 'F';													// ... set right reaction character,
 		zm_addReaction( reaction, &nodeArr );		// and put it in buffer.
-		zm_addReaction( '\0', &nodeArr );		
+		zm_pushReaction( reaction, &optimizedNodeArr );
 	}
 	// If you can turn left on crossroad ...
 	else if( node_type == FULL_CROSS || node_type == LEFT_RIGHT_CROSS || node_type == STRAIGHT_LEFT_CROSS ){
 		reaction = 'L';													// ... set right reaction character,
 		zm_addReaction( reaction, &nodeArr );		// and put it in buffer.
+		zm_pushReaction( reaction, &optimizedNodeArr );
 		driveLeft( speed );											// Start turning left
 		while( la_getSensorState() & 0x0C );		// until you get another line (line -> white -> line sequence).
 		while( la_getSensorState() != 0x0C );
@@ -184,6 +288,7 @@ char zm_nodeReaction( uint8_t node_type, uint8_t speed ){
 	else if( node_type == DEAD_END ){
 		reaction = 'T';													// ... set right reaction character,
 		zm_addReaction( reaction, &nodeArr );		// and put it in buffer.
+		zm_pushReaction( reaction, &optimizedNodeArr );
 		driveRight( speed );										// Turn around.
 		while( la_getSensorState() != 0x0C );
 		driveStop();
@@ -192,6 +297,7 @@ char zm_nodeReaction( uint8_t node_type, uint8_t speed ){
 	else if( node_type == STRAIGHT_RIGHT_CROSS ){
 		reaction = 'S';													// ... set right reaction character and save it in buffer.
 		zm_addReaction( reaction, &nodeArr );	
+		zm_pushReaction( reaction, &optimizedNodeArr );
 	}
 	// If there is only some turn...
 	else if( node_type == LEFT_TURN ){
@@ -215,89 +321,228 @@ char zm_nodeReaction( uint8_t node_type, uint8_t speed ){
 
 
 void _delay_ms( uint32_t value ){
-	uint32_t i;
-	for(i=0; i<(6500*value); i++);
+	
+	hal_delayMs( value );
 }
 
 
+/**
+	@brief	Saved reactions in order of their 2-bit codes.
+*/
+static const char zm_codeToReaction[4] = { 'L', 'S', 'R', 'T' };
+
+/**
+	@brief	Function writes 2-bit code of reaction at given position.
+*/
+static void zm_setCode( NodeArr_t * node_array, uint16_t index, uint8_t code ){
+
+	uint8_t shift = (index & 3) * 2;
+	node_array->tab[ index >> 2 ] = (node_array->tab[ index >> 2 ] & ~(3 << shift)) | (code << shift);
+}
+
 void zm_addReaction( char reaction, NodeArr_t * node_array ){
 	
-	// Put character and increment an iterator.
-	node_array->tab[node_array->max_index++] = reaction;
+	uint8_t code;
+	
+	switch( reaction ){
+		case 'L':	code = 0;	break;
+		case 'S':	code = 1;	break;
+		case 'R':	code = 2;	break;
+		case 'T':	code = 3;	break;
+		case 'F':	node_array->finished = 1;	return;
+		default:	return;
+	}
+	// Put code and increment length.
+	if( node_array->length < MAX_NBR_OF_NODES ) zm_setCode( node_array, node_array->length++, code );
+	else node_array->overflow = 1;
 };
 
+char zm_popReaction( NodeArr_t * node_array ){
+	
+	if( node_array->length == 0 ) return 0;
+	node_array->length--;
+	return zm_reactionAt( node_array, node_array->length );
+}
+
 char zm_getReaction( NodeArr_t * node_array ){
 	
 	// Get character and increment an interator.
-	return node_array->tab[node_array->max_index++];
+	char reaction = zm_reactionAt( node_array, node_array->cursor );
+	if( reaction != 0 ) node_array->cursor++;
+	return reaction;
+}
+
+/**
+	@brief	Function returns reaction saved in given cell of buffer, without checking its length.
+*/
+static char zm_cellAt( const NodeArr_t * node_array, uint16_t index ){
+
+	return zm_codeToReaction[ (node_array->tab[ index >> 2 ] >> ((index & 3) * 2)) & 3 ];
 }
 
+char zm_reactionAt( const NodeArr_t * node_array, uint16_t index ){
+	
+	if( index < node_array->length ) return zm_cellAt( node_array, index );
+	if( index == node_array->length && node_array->finished ) return 'F';
+	return 0;
+}
 
 
+/**
+	@brief	Function returns number of quarter turns (counter-clockwise) of L, S or R reaction, -1 for other ones.
+*/
+static int8_t zm_quarterTurns( char reaction ){
 
-void zm_routeOptimizer( const char * old_route, char * new_route){
+	switch( reaction ){
+		case 'S':	return 0;
+		case 'L':	return 1;
+		case 'R':	return 3;
+		default:	return -1;
+	}
+}
 
-	static char temp[ MAX_NBR_OF_NODES ];
-  uint8_t compressed = 0;
-	
-	// Hop will be 1 or 3. It depend on 'T' command in node array.
-  uint8_t hop;	
-	uint16_t i;
-	uint16_t output_index = 0;
-  uint16_t route_table_length = strlen(old_route);
-	
-	// Clear temp array
-	//for(i=0; i<route_table_length; i++)	*((char*)temp+i) = 0;
+/**
+	@brief	Function returns one reaction equivalent to 'before', 'T', 'after' (rules of ::zm_routeOptimizer).
+	@details	Zumo comes back to the same node, so the reaction is sum of all three turns.
+	@return	Return value is 0 when there is no rule for given pair.
+*/
+static char zm_turnRule( char before, char after ){
 
-	// Read each command
-	for( i=0; i<route_table_length; i += hop ){
+	static const char zm_sumToReaction[4] = { 'S', 'L', 'T', 'R' };
+	int8_t b = zm_quarterTurns( before ), a = zm_quarterTurns( after );
 
-		// Check whether next command is not a 'turn' command...
-		if( old_route[i+1] != 'T' ){
-			*((char*)temp+output_index) = *(old_route+i);		// and write it to temp array.
-			hop = 1;
-		}
-		// If is a 'T' you can change all three commands in one...
-		else{
+	if( b < 0 || a < 0 ) return 0;
+	return zm_sumToReaction[ (b + 2 + a) & 3 ];
+}
 
-			compressed = 1;
-			hop = 3;
-			
-			// ... using this formula.
-			if(  		 *(old_route+i) == 'L' &&  *(old_route+i+2) == 'R'  )	*((char*)temp+output_index) = 'T';
-			else if( *(old_route+i) == 'L' &&  *(old_route+i+2) == 'S'  )	*((char*)temp+output_index) = 'R';
-			else if( *(old_route+i) == 'R' &&  *(old_route+i+2) == 'L'  )	*((char*)temp+output_index) = 'T';
-			else if( *(old_route+i) == 'S' &&  *(old_route+i+2) == 'L'  )	*((char*)temp+output_index) = 'R';
-			else if( *(old_route+i) == 'S' &&  *(old_route+i+2) == 'S'  )	*((char*)temp+output_index) = 'T';
-			else if( *(old_route+i) == 'L' &&  *(old_route+i+2) == 'L'  )	*((char*)temp+output_index) = 'S';
-		}
-		// Move cursor (pointer) to the next address.
-		output_index++;
+/**
+	@brief	Function reduces end of route while 'T' is just before the last reaction (rules of ::zm_routeOptimizer).
+	@param	node_array Route buffer used as a stack.
+*/
+static void zm_reduceTop( NodeArr_t * node_array ){
+
+	char reaction;
+
+	// Three commands become one. Result can make next rule with 'T' before it.
+	while( node_array->length >= 3 && zm_reactionAt( node_array, node_array->length-2 ) == 'T' ){
+		reaction = zm_turnRule( zm_reactionAt( node_array, node_array->length-3 ), zm_reactionAt( node_array, node_array->length-1 ) );
+		if( reaction == 0 ) break;
+		node_array->length -= 3;
+		zm_addReaction( reaction, node_array );
+	}
+}
+
+void zm_pushReaction( char reaction, NodeArr_t * node_array ){
+
+	zm_addReaction( reaction, node_array );
+	zm_reduceTop( node_array );
+}
+
+void zm_routeOptimizer( const NodeArr_t * old_route, NodeArr_t * new_route){
+
+	uint16_t i;
+	uint16_t length = old_route->length;
+	uint8_t finished = old_route->finished;
+
+	// Rules would join reactions around the gap of dropped ones.
+	new_route->cursor = 0;
+	if( old_route->overflow ){
+		new_route->length = 0;
+		new_route->finished = 0;
+		new_route->overflow = 1;
+		return;
 	}
-	// Add 'ending'
-	*((char*)temp+output_index) = '\0';
+	new_route->overflow = 0;
+
+	// Output array is used as a stack. It never gets ahead of input, so both arrays can be the same one.
+	// Input cells are read directly (up to saved length), because output length is reset here.
+	new_route->length = 0;
+	for( i=0; i<length; i++ ) zm_pushReaction( zm_cellAt( old_route, i ), new_route );
+	new_route->finished = finished;
+}
+
+
+/**
+	@brief	Function performs movement in crossroad.
+	@param	node_type Type of crossroad (it tells on which line Zumo stops when it turns around).
+	@param	reaction L, S, R or T.
+	@param	speed Rotation speed.
+*/
+static void zm_crossMove( uint8_t node_type, char reaction, uint8_t speed ){
 	
-	// If you have optimized something run procedure again.
-	if( compressed == 1 )	zm_routeOptimizer( temp, new_route);
-	// otherwise copy orders to destination array.
-	else{
-		for( i=0; i<strlen(temp); i++ )	*((char*)new_route+i) = *(temp+i);
-		*((char*)new_route+strlen(temp)) = '\0';
+	switch( reaction ){
+		
+		
+		// turn in right direction
+		case 'S':
+			break;
+		
+		case 'L':
+			driveLeft( speed );
+			while( la_getSensorState() & 0x0C );
+			while( la_getSensorState() != 0x0C );
+			driveStop();
+			break;
+		
+		case 'R':
+			driveRight( speed );
+			while( la_getSensorState() & 0x0C );
+			while( la_getSensorState() != 0x0C );
+			driveStop();
+			break;
+		
+		// If you have to turn around you should check on which number of line you have to stop turning
+		case 'T':
+			
+			if( node_type == LEFT_RIGHT_CROSS || node_type == FULL_CROSS ){
+				driveRight( speed );
+				// On second line
+				while( la_getSensorState() & 0x0C );
+				while( la_getSensorState() != 0x0C );
+				while( la_getSensorState() & 0x0C );
+				while( la_getSensorState() != 0x0C );		
+			}
+			else if( node_type == STRAIGHT_LEFT_CROSS ){
+				driveRight( speed );
+				// On first line
+				while( la_getSensorState() & 0x0C );
+				while( la_getSensorState() != 0x0C );
+			}
+			else if( node_type == STRAIGHT_RIGHT_CROSS ){
+				driveLeft( speed );
+				// On first line
+				while( la_getSensorState() & 0x0C );
+				while( la_getSensorState() != 0x0C );
+			}
+			driveStop();			
+			break;
+		
+		default:
+			break;
 	}
 }
 
+char zm_guidedNodeReaction( uint8_t node_type, char reaction, uint8_t speed ){
+	
+	// Save reaction like in ::zm_nodeReaction ...
+	zm_addReaction( reaction, &nodeArr );
+	zm_pushReaction( reaction, &optimizedNodeArr );
+	// ... and do it.
+	zm_crossMove( node_type, reaction, speed );
+	return reaction;
+}
 
 char zm_strictNodeReaction( NodeArr_t * node_array, uint8_t node_type, uint8_t speed ){
 	
-	char reaction;
+	char reaction = 0;
 	
 	// If you get to the finish ...
 	if( node_type == MAZE_END ){
-		reaction = zm_getReaction( &optimizedNodeArr );		// ... get last command ('F').
+		reaction = zm_getReaction( node_array );		// ... get last command ('F').
 	}
 	// If there is dead end ... 
 	else if( node_type == DEAD_END ){
-		reaction = zm_getReaction( &optimizedNodeArr );		// ... get next command ('T')
+		reaction = zm_getReaction( node_array );		// ... get next command ('T')
 		driveRight( speed );															// and turn around.
 		while( la_getSensorState() & 0x0C );
 		while( la_getSensorState() != 0x0C );
@@ -325,60 +570,79 @@ char zm_strictNodeReaction( NodeArr_t * node_array, uint8_t node_type, uint8_t s
 					|| node_type == STRAIGHT_LEFT_CROSS 
 					|| node_type == STRAIGHT_RIGHT_CROSS ){
 		
-		reaction = zm_getReaction( &optimizedNodeArr );		// ... ask for help ...
-						
-		// ... and follow the order
-		switch( reaction ){
-			
-			
-			// turn in right direction
-			case 'S':
-				break;
-			
-			case 'L':
-				driveLeft( speed );
-				while( la_getSensorState() & 0x0C );
-				while( la_getSensorState() != 0x0C );
-				driveStop();
-				break;
-			
-			case 'R':
-				driveRight( speed );
-				while( la_getSensorState() & 0x0C );
-				while( la_getSensorState() != 0x0C );
-				driveStop();
-				break;
-			
-			// If you have to turn around you should check on which number of line you have to stop turning
-			case 'T':
-				
-				if( node_type == LEFT_RIGHT_CROSS || node_type == FULL_CROSS ){
-					driveRight( speed );
-					// On second line
-					while( la_getSensorState() & 0x0C );
-					while( la_getSensorState() != 0x0C );
-					while( la_getSensorState() & 0x0C );
-					while( la_getSensorState() != 0x0C );		
-				}
-				else if( node_type == STRAIGHT_LEFT_CROSS ){
-					driveRight( speed );
-					// On first line
-					while( la_getSensorState() & 0x0C );
-					while( la_getSensorState() != 0x0C );
-				}
-				else if( node_type == STRAIGHT_RIGHT_CROSS ){
-					driveLeft( speed );
-					// On first line
-					while( la_getSensorState() & 0x0C );
-					while( la_getSensorState() != 0x0C );
-				}
-				driveStop();			
-				break;
-			
-			default:
-				break;
-		}
+		reaction = zm_getReaction( node_array );		// ... ask for help ...
+		zm_crossMove( node_type, reaction, speed );			// ... and follow the order.
 	}
 
 	return reaction;
 }
+
+uint8_t zm_nodeSignature( uint8_t node_type ){
+	
+	switch( node_type ){
+		case FULL_CROSS:
+		case LEFT_RIGHT_CROSS:			return ZM_EVENT_LEFT | ZM_EVENT_RIGHT;
+		case STRAIGHT_LEFT_CROSS:
+		case LEFT_TURN:							return ZM_EVENT_LEFT;
+		case STRAIGHT_RIGHT_CROSS:
+		case RIGHT_TURN:						return ZM_EVENT_RIGHT;
+		case MAZE_END:							return ZM_EVENT_FINISH;
+		default:										return ZM_EVENT_END;
+	}
+}
+
+char zm_passNode( uint8_t node_type, char reaction, uint8_t speed ){
+	
+	uint8_t inner = (uint8_t)((uint16_t)speed * ZM_ARC_INNER / 100);
+	uint16_t outer = (uint16_t)speed * ZM_ARC_OUTER / 100;
+	uint32_t start = hal_micros();
+	uint8_t arrival = zm_control.detector.event;
+	uint8_t i;
+	
+	if( outer > 100 ) outer = 100;
+	
+	// Branches of crossroad can come under array a few frames one after another, so frames are collected for a while (frame rate varies).
+	for( i=0; i<ZM_DEBOUNCE_FRAMES || hal_micros() - start < ZM_PASS_WINDOW_US; i++ ) zm_detectorStep( &zm_control.detector, la_waitSensorState() );
+	
+	// Expected node is confirmed by arrival events. Other one is stopped in, so it can be checked as usual.
+	// Window usually ends behind the node (event is END then), so arrival event is restored for ::zm_checkNode, unless finish is seen.
+	if( (zm_control.detector.seen & ZM_EVENT_NODE) != zm_nodeSignature( node_type ) ){
+		if( zm_control.detector.event != ZM_EVENT_FINISH ) zm_control.detector.event = arrival;
+		driveStop();
+		return 0;
+	}
+	
+	// Plain turn needs no command.
+	if( node_type == LEFT_TURN ) reaction = 'l';
+	else if( node_type == RIGHT_TURN ) reaction = 'r';
+	
+	switch( reaction ){
+		
+		// Crossroad with line ahead - go straight until branches are behind the array.
+		case 'S':
+			driveForward( speed );
+			while( la_getSensorState() & 0x21 );
+			return 'S';
+		
+		// Arc: outer track speeds up, inner one is slowed down. Line ahead goes away from the center, then the new one comes.
+		case 'L':	case 'l':
+			driveForwardLeftTrack( inner );
+			driveForwardRightTrack( outer );
+			while( la_getSensorState() & 0x0C );
+			while( la_getSensorState() != 0x0C );
+			return reaction;
+		
+		case 'R':	case 'r':
+			driveForwardLeftTrack( outer );
+			driveForwardRightTrack( inner );
+			while( la_getSensorState() & 0x0C );
+			while( la_getSensorState() != 0x0C );
+			return reaction;
+		
+		default:
+			break;
+	}
+	
+	driveStop();
+	return 0;
+}
@@ -4,15 +4,40 @@
 */
 #ifndef ZUMO_MAZE_H_
 #define ZUMO_MAZE_H_
-#include "MKL46Z4.h"
+#include <stdint.h>
+#include "zumo_hal.h"
 
 
 /**
 	@brief	Defines how many nodes will be in the maze.	In one crossroad can be many nodes (Zumo may reach the same crossroad from different directions).
 	@details	Obviously this is only approximation and it should be grater than actual number of nodes.
-	@warning	Do not put here to big value because optimization function is based on recursion and memory problems may occur.
+						Every node takes 2 bits of ::NodeArr_t, so it has to be multiple of 4.
 */
-#define MAX_NBR_OF_NODES 100
+#define MAX_NBR_OF_NODES 400
+
+/**
+	@brief	Frequency of line following control loop (::zm_controlTick) [Hz].
+*/
+#define ZM_CONTROL_HZ 1000
+
+/**
+	@brief	Acceleration and deceleration of speed profile (::zm_driveProfiled) [speed units (0-100) per second].
+*/
+#define ZM_ACCELERATION 400
+
+/**
+	@brief	Track speeds in arc turn (::zm_passNode), in percent of approach speed. Outer track is limited to 100.
+	@details	Inner track nearly stops, so Zumo pivots about it and the new line comes under sensors when axis is over node.
+						Outer track speeds up to keep rotation as fast as spin in place.
+*/
+#define ZM_ARC_INNER 0
+#define ZM_ARC_OUTER 250
+
+/**
+	@brief	Percent of segment length, where speed profile has to be back at end speed.
+	@details	Distance is estimated from commanded speed, so the rest is a margin for motor lag and measurement error.
+*/
+#define ZM_BRAKE_POINT 85
 
 
 /*!
@@ -30,19 +55,54 @@
  */
  
 /**
-	@brief	Node definition
+	@brief	Number of consecutive frames which confirm event of node detector (::zm_detectorStep).
 */
-#define NODE ((la_getSensorState() == FINISH)||(la_getSensorState() == ALL)||(la_getSensorState() == LEFT)||(la_getSensorState() == RIGHT)||(la_getSensorState() == EMPTY))
+#define ZM_DEBOUNCE_FRAMES 2
+
+/**
+	@brief	Time after arrival at known node in which ::zm_passNode collects branches [us] (at least ::ZM_DEBOUNCE_FRAMES frames).
+*/
+#define ZM_PASS_WINDOW_US 6000
+
+/*!
+ * @addtogroup Detector_events Node detector events
+ * @{
+ */
+#define ZM_EVENT_LINE		0x01		// line without branches under array
+#define ZM_EVENT_LEFT		0x02		// branch on the left (111100 seen)
+#define ZM_EVENT_RIGHT	0x04		// branch on the right (001111 seen)
+#define ZM_EVENT_END		0x08		// end of line (white board)
+#define ZM_EVENT_FINISH	0x10		// finish marker (101101)
+#define ZM_EVENT_NODE		( ZM_EVENT_LEFT | ZM_EVENT_RIGHT | ZM_EVENT_END | ZM_EVENT_FINISH )
+/**
+ * @}
+ */
+
+/**
+	@brief	Node detector - state machine fed with one sensor frame per step (see ::zm_detectorStep).
+*/
+typedef struct{
+	uint8_t event;				/**< Confirmed event (0 - none yet) */
+	uint8_t candidate;		/**< Event of the last frame */
+	uint8_t count;				/**< Number of consecutive frames with candidate event */
+	uint8_t seen;					/**< Sum of events confirmed since ::zm_detectorInit */
+} zm_detector_t;
 
 
 
 // Node buffer structure
 /**
   @brief Buffer structure for ::nodeArr and ::optimizedNodeArr
+	@details	Saved reactions are only L, S, R and T, so each one is packed in 2 bits (four in one byte, the first one in the lowest bits).
+						'F' is not stored: it is implicit after the last reaction when ::finished flag is set.
+						Use access functions (::zm_addReaction, ::zm_pushReaction, ::zm_popReaction, ::zm_getReaction, ::zm_reactionAt).
 */
 typedef struct{
-	char tab[ MAX_NBR_OF_NODES ];		/**< Reaction array */
-	uint16_t max_index; 						/**< Index of next element */
+	uint8_t tab[ MAX_NBR_OF_NODES / 4 ];		/**< Packed reaction array */
+	uint16_t length;												/**< Number of saved reactions */
+	uint16_t cursor; 												/**< Index of next element read by ::zm_getReaction */
+	uint8_t finished;												/**< 1 - route ends with 'F' */
+	uint8_t overflow;												/**< 1 - reactions over ::MAX_NBR_OF_NODES were dropped, route is not complete */
 } NodeArr_t;
 
 
@@ -50,11 +110,11 @@ typedef struct{
 /**
 	@brief Buffer for registered actions
 */
-extern NodeArr_t nodeArr;
+extern HAL_STATE NodeArr_t nodeArr;
 /**
 	@brief Buffer for orders
 */
-extern NodeArr_t optimizedNodeArr;
+extern HAL_STATE NodeArr_t optimizedNodeArr;
 
 
 /**
@@ -73,6 +133,23 @@ enum Node_type{
 
 
 // Main functions
+/**
+	@brief	Function resets node detector.
+	@param	detector Pointer to detector.
+*/
+void		zm_detectorInit( zm_detector_t * detector );
+
+/**
+	@brief	Function feeds node detector with one sensor frame.
+	@details	Frame is classified as one of events (::ZM_EVENT_LEFT and ::ZM_EVENT_RIGHT together when line is under all sensors).
+						Event is confirmed when ::ZM_DEBOUNCE_FRAMES frames in a row give it, so single noisy frames are skipped.
+						Each frame should be given once (::la_waitSensorState, ::la_peekFrameNumber).
+	@param	detector Pointer to detector.
+	@param	state Sensor state of the frame.
+	@return	Return value is event confirmed by this frame, 0 when confirmed event does not change.
+*/
+uint8_t	zm_detectorStep( zm_detector_t * detector, char state );
+
 /**
 	@brief	Function is checking minimum and maximum value from each light sensor while Zumo is turning around.
 	@details	Best way to calibrate Zumo is to put it on the brightest part of line. You are sure that rest of maze will be identified well.
@@ -83,13 +160,33 @@ void		zm_calibration( uint8_t speed );
 
 /**
 	@brief Function which allows to follow the line until Zumo will reach the node (crossroad, dead end etc. See -> ::Node_type).
-	@details	There is software PID controller in the function. It reads light sensors state and manipulates voltage of engines by PWM.
+	@details	PID controller runs in control timer interrupt (::zm_controlTick, ::ZM_CONTROL_HZ), the function only waits until node is reached.
 	@param speed Zumo velocity in range 0-100.
 */
 void		zm_driveToNode( uint8_t speed );
 
+/**
+	@brief Function follows the line to the next node with trapezoidal speed profile.
+	@details	Zumo accelerates from speed towards top_speed and brakes back to speed before ::ZM_BRAKE_POINT percent of distance,
+						so it reaches node at speed (::zm_checkNode works as after ::zm_driveToNode).
+	@param speed Start and end velocity in range 0-100.
+	@param top_speed The highest velocity in range 0-100.
+	@param distance Expected length of segment [speed * ms], e.g. drive time at exploration speed multiplied by it. 0 - constant speed.
+	@param pass 0 - stop in node, 1 - keep going straight at current speed (call ::zm_passNode then).
+*/
+void		zm_driveProfiled( uint8_t speed, uint8_t top_speed, uint32_t distance, uint8_t pass );
+
+/**
+	@brief	One step of line following control loop, called by control timer interrupt (::hal_controlStart).
+	@details	There is software PID controller in the function. It reads line position of the last frame (::la_readFrame) and manipulates voltage of engines by PWM.
+						Each new frame feeds node detector (::zm_detectorStep). Motors are stopped as soon as it confirms node.
+*/
+void		zm_controlTick( void );
+
 /**
 	@brief Function checks which type of node is on the road.
+	@details	Arrival event of ::zm_driveToNode tells dead end and finish. Crossroad is driven through while node detector
+						collects branches, until it confirms line or white board ahead.
 	@param speed Zumo velocity in range 0-100.
 	@return Return value is the node type enumerated in ::Event_type
 */
@@ -107,6 +204,8 @@ uint8_t	zm_checkNode( uint8_t speed );
 							<li> l - left turn (turn left but do not save this reaction)
 							<li> r - right turn (turn right but do not save this reaction)
 						</ul>
+						Saved reaction goes to ::nodeArr (whole exploration) and to ::optimizedNodeArr, where it is reduced at once (::zm_pushReaction).
+						So the shortest path is ready when the end of maze is reached.
 	@param	node_type Type of node where movement will be done.
 	@param	speed Rotation speed.
 	@return	Return value is the oldest character in buffer.
@@ -114,10 +213,21 @@ uint8_t	zm_checkNode( uint8_t speed );
 */
 char		zm_nodeReaction( uint8_t node_type, uint8_t speed );
 
+/**
+	@brief	Function performs given reaction in crossroad and saves it like ::zm_nodeReaction does.
+	@details	It is used when reaction is chosen by other exploration policy than left-hand rule (see ::mp_choose).
+	@param	node_type Type of crossroad (::FULL_CROSS, ::STRAIGHT_LEFT_CROSS, ::STRAIGHT_RIGHT_CROSS or ::LEFT_RIGHT_CROSS).
+	@param	reaction L, S, R or T. It has to be possible in this crossroad.
+	@param	speed Rotation speed.
+	@return	Return value is the performed reaction.
+*/
+char		zm_guidedNodeReaction( uint8_t node_type, char reaction, uint8_t speed );
+
 /**
 	@brief	Function creates the shortest path based on previous.
-	@details	Function looks for 'T' reaction and right combination of adjacent values.
-						Rules
+	@details	Function looks for 'T' reaction and right combination of adjacent values. Commands are reduced while they are read,
+						in one pass (time proportional to route length) and without extra buffer.
+						Rules (sum of three turns, left-hand exploration gives the first six)
 						<ul>
 							<li> LTR = T
 							<li> LTS = R
@@ -125,13 +235,16 @@ char		zm_nodeReaction( uint8_t node_type, uint8_t speed );
 							<li> STL = R
 							<li> STS = T
 							<li> LTL = S
+							<li> RTR = S
+							<li> RTS = L
+							<li> STR = L
 						</ul>						
-						Reactions legend in ::zm_nodeReaction
-	@param	old_route Pointer to input node buffer
-	@param	new_route Pointer to output (optimized) node buffer.
-	@warning	Function uses recursion.
+						Triples without a rule are left unchanged. Reactions legend in ::zm_nodeReaction
+						Truncated route (overflow flag) is not optimized: output is empty, with overflow flag set.
+	@param	old_route Pointer to input node buffer.
+	@param	new_route Pointer to output (optimized) node buffer. It can be the same as old_route.
 */
-void		zm_routeOptimizer( const char * old_route, char * new_route);
+void		zm_routeOptimizer( const NodeArr_t * old_route, NodeArr_t * new_route);
 
 /**
 	@brief	Zumo performs reaction in the node according to external command.
@@ -142,6 +255,24 @@ void		zm_routeOptimizer( const char * old_route, char * new_route);
 */
 char		zm_strictNodeReaction( NodeArr_t * node_array, uint8_t node_type, uint8_t speed );
 
+/**
+	@brief	Function returns detector event confirmed when Zumo arrives at node of given type.
+	@param	node_type Type of node enumerated in ::Node_type.
+	@return	Return value is ::ZM_EVENT_LEFT and/or ::ZM_EVENT_RIGHT, ::ZM_EVENT_FINISH or ::ZM_EVENT_END (dead end).
+*/
+uint8_t	zm_nodeSignature( uint8_t node_type );
+
+/**
+	@brief	Zumo passes node of known type without stopping (::zm_driveProfiled with pass flag has just reached it).
+	@details	Node is not classified, arrival event is only compared with signature of expected type (::zm_nodeSignature).
+						Straight is driven through at speed, turns are arcs (::ZM_ARC_INNER, ::ZM_ARC_OUTER).
+	@param	node_type Expected type of node (e.g. from ::mp_profile_t).
+	@param	reaction Command in crossroad: 'S', 'L' or 'R'. It is not used in plain turn.
+	@param	speed Velocity in range 0-100.
+	@return	Return value is performed movement ('S', 'L', 'R', 'l', 'r'), or 0 when node does not match (Zumo stops in the node, use ::zm_checkNode - it gets arrival event and all branches seen).
+*/
+char		zm_passNode( uint8_t node_type, char reaction, uint8_t speed );
+
 
 
 // Other functions
@@ -152,24 +283,46 @@ char		zm_strictNodeReaction( NodeArr_t * node_array, uint8_t node_type, uint8_t
 void zm_clearArray( NodeArr_t * node_array );
 
 /**
-	@brief	Function puts one character (movement code) to node buffer. Maximum number of elements is declared in ::MAX_NBR_OF_NODES.
+	@brief	Function puts one character (movement code) to node buffer. Maximum number of elements is ::MAX_NBR_OF_NODES, further ones are dropped (overflow flag is set).
+	@details	'F' only marks the end of route. Other characters than L, S, R, T and F are ignored.
 	@param	reaction ASCII encoded movement.
 	@param	node_array Pointer to buffer structure
 */
 void zm_addReaction( char reaction, NodeArr_t * node_array );
 
+/**
+	@brief	Function puts one character to node buffer and reduces the buffer with rules of ::zm_routeOptimizer.
+	@details	Buffer holds optimized route of everything pushed so far.
+	@param	reaction ASCII encoded movement.
+	@param	node_array Pointer to buffer structure
+*/
+void zm_pushReaction( char reaction, NodeArr_t * node_array );
+
+/**
+	@brief	Function takes out the last saved character (it does not change 'F' flag).
+	@param	node_array Pointer to buffer structure
+	@return	Return value is removed character or 0 when buffer is empty.
+*/
+char zm_popReaction( NodeArr_t * node_array );
+
 /**
 	@brief	Function getting one character from node buffer.
 	@param	node_array Pointer to buffer structure
-	@return	Return value is the oldest character in buffer.
-	@warning	Function does not check length of node array.
+	@return	Return value is the oldest not read character in buffer ('F' or 0 after the last one, see ::zm_reactionAt).
 */
 char zm_getReaction( NodeArr_t * node_array );
 
 /**
-	@brief Simple delay function based on for loop.
+	@brief	Function returns character at given position, so the buffer can be iterated without changing its cursor.
+	@param	node_array Pointer to buffer structure
+	@param	index Position in route.
+	@return	Return value is reaction; 'F' right after the last one when route is finished, otherwise 0 at the end.
+*/
+char zm_reactionAt( const NodeArr_t * node_array, uint16_t index );
+
+/**
+	@brief Simple delay function based on HAL millisecond clock.
 	@param value Time in milliseconds
-	@warning Function is not precise.
 */
 void _delay_ms( uint32_t value );
 
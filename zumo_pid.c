@@ -0,0 +1,59 @@
+/**
+	@file	zumo_pid.c
+	@brief	Fixed-point PID controller without division (Cortex-M0+ has no divide instruction).
+*/
+#include "zumo_pid.h"
+
+
+void pid_init( pid_ctrl_t * pid, const pid_gains_t * gains, int32_t out_min, int32_t out_max ){
+
+	pid->gains = gains;
+	pid->integral = 0;
+	pid->derivative = 0;
+	pid->previous_error = 0;
+	pid->out_min = out_min;
+	pid->out_max = out_max;
+}
+
+int32_t pid_update( pid_ctrl_t * pid, int32_t error ){
+
+	const pid_gains_t * gains = pid->gains;
+	int32_t min = pid->out_min * PID_ONE;
+	int32_t max = pid->out_max * PID_ONE;
+	int32_t integral = pid->integral + gains->ki * error;
+	int32_t output;
+
+	// Low-pass filtered derivative: d += alpha * (raw - d)
+	pid->derivative += (int32_t)(((int64_t)gains->d_alpha * ((error - pid->previous_error) * PID_ONE - pid->derivative)) >> 16);
+	pid->previous_error = error;
+
+	// Integral term is clamped to output limits.
+	if( integral > max ) integral = max;
+	if( integral < min ) integral = min;
+
+	output = gains->kp * error + integral + (int32_t)(((int64_t)gains->kd * pid->derivative) >> 16);
+
+	// Integrate only when output is not saturated by this error.
+	if( output > max ){
+		output = max;
+		if( error < 0 ) pid->integral = integral;
+	}
+	else if( output < min ){
+		output = min;
+		if( error > 0 ) pid->integral = integral;
+	}
+	else pid->integral = integral;
+
+	// Q16 -> integer (arithmetic shift rounds towards minus infinity, so round half up)
+	return (output + PID_ONE/2) >> 16;
+}
+
+const pid_gains_t * pid_selectGains( const pid_gains_t * table, uint8_t size, uint8_t speed ){
+
+	uint8_t i;
+
+	for( i=0; i<size-1; i++ ){
+		if( speed <= table[i].max_speed ) break;
+	}
+	return &table[i];
+}
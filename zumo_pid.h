@@ -0,0 +1,66 @@
+/**
+	@file	zumo_pid.h
+	@brief	Fixed-point PID controller without division (Cortex-M0+ has no divide instruction).
+	@details	Gains are Q16 numbers (65536 means 1.0) given per control step, so sampling period is already in them.
+						Output is clamped to its limits and integral term is clamped to the same limits (anti-windup).
+						Error is not integrated when output is saturated and the error would push it further (conditional integration).
+						Derivative of error goes through first order low-pass filter.
+						Gain products (gain * error) have to fit in 32 bits.
+*/
+#ifndef ZUMO_PID_H_
+#define ZUMO_PID_H_
+#include <stdint.h>
+
+/**
+	@brief	1.0 in Q16 format.
+*/
+#define PID_ONE 65536L
+
+/**
+	@brief	Gain set. Table of them sorted by ::max_speed is a gain schedule (see ::pid_selectGains).
+*/
+typedef struct{
+	uint8_t max_speed;				/**< The highest commanded speed of this gain set */
+	int32_t kp;								/**< Proportional gain [Q16] */
+	int32_t ki;								/**< Integral gain per step [Q16] */
+	int32_t kd;								/**< Derivative gain per step [Q16] */
+	int32_t d_alpha;					/**< Derivative filter coefficient [Q16], ::PID_ONE - no filtering */
+} pid_gains_t;
+
+/**
+	@brief	Controller state.
+*/
+typedef struct{
+	const pid_gains_t * gains;
+	int32_t integral;					/**< Integral term [Q16 of output] */
+	int32_t derivative;				/**< Filtered derivative of error [Q16] */
+	int32_t previous_error;
+	int32_t out_min, out_max;	/**< Output limits */
+} pid_ctrl_t;
+
+/**
+	@brief	Function resets controller.
+	@param	pid Pointer to controller.
+	@param	gains Gain set, it is not copied.
+	@param	out_min,out_max Output limits.
+*/
+void pid_init( pid_ctrl_t * pid, const pid_gains_t * gains, int32_t out_min, int32_t out_max );
+
+/**
+	@brief	Function makes one control step.
+	@param	pid Pointer to controller.
+	@param	error Set point minus measured value.
+	@return	Return value is controller output in range ::out_min - ::out_max.
+*/
+int32_t pid_update( pid_ctrl_t * pid, int32_t error );
+
+/**
+	@brief	Function selects gain set for commanded speed.
+	@param	table Gain sets sorted by ::max_speed.
+	@param	size Number of gain sets.
+	@param	speed Commanded speed.
+	@return	Return value is the first set with ::max_speed not lower than speed (the last one for higher speeds).
+*/
+const pid_gains_t * pid_selectGains( const pid_gains_t * table, uint8_t size, uint8_t speed );
+
+#endif
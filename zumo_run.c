@@ -0,0 +1,328 @@
+/**
+	@file	zumo_run.c
+	@brief	Three phases of maze solving run (exploration, optimization, replay) with Bluetooth telemetry.
+*/
+#include "zumo_run.h"
+#include "bluetooth.h"
+#include "zumo_ledArray.h"
+#include "zumo_map.h"
+#include "zumo_maze.h"
+#include "zumo_store.h"
+#include "motorDriver.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Global variables
+HAL_STATE zr_record_t zumoRecord;
+
+// Received Bluetooth command (static, because stack is too small)
+static HAL_STATE char zr_command[ BUFF_SIZE ];
+
+// Fingerprint measured in the last replay
+static HAL_STATE zr_fingerprint_t zr_fingerprint;
+
+// Speed profile of ::optimizedNodeArr
+static HAL_STATE mp_profile_t zr_profile;
+static HAL_STATE uint8_t zr_segment;				// Profile segment of the next drive
+static HAL_STATE uint8_t zr_profileLost;		// 1 - drive at constant speed until the next crossroad
+
+
+void zr_sendArrayState( char state ){
+	int8_t i;
+	
+	for( i=5; i>=0; i--){
+		bt_sendChar( (state & (1<<i)) ? '1' : '0' );
+	}
+	bt_sendChar( '\r' );
+	bt_sendChar( '\n' );
+}
+
+void zr_sendRoute( const NodeArr_t * route ){
+	
+	uint16_t i;
+	char reaction;
+	
+	for( i=0; (reaction = zm_reactionAt( route, i )) != 0; i++ ){
+		bt_sendChar( reaction );
+	}
+	bt_sendChar( '\r' );
+}
+
+void zr_sendNumber( uint32_t value ){
+
+	char digits[10];
+	uint8_t n = 0;
+
+	// Digits come from the lowest one.
+	do{
+		digits[ n++ ] = '0' + value % 10;
+		value /= 10;
+	}while( value != 0 );
+	while( n > 0 ) bt_sendChar( digits[ --n ] );
+}
+
+
+/**
+	@brief	Function sends via Bluetooth sensor frame rate measured over the last frames (::la_historyRate).
+*/
+static void zr_sendFrameRate( void ){
+
+	bt_sendStr("Ramki: ");
+	zr_sendNumber( la_historyRate() );
+	bt_sendStr(" /s\r");
+}
+
+void zr_selectPolicy( mp_policy_t policy ){
+
+	mp_setPolicy( policy );
+	bt_sendStr("Strategia: ");
+	bt_sendStr( mp_policyName( mp_getPolicy() ) );
+	bt_sendChar( '\r' );
+}
+
+void zr_setGoal( int16_t forward, int16_t left ){
+
+	mp_setGoal( (int32_t)forward * ZR_CELL_MS, (int32_t)left * ZR_CELL_MS );
+}
+
+void zr_readCommand( void ){
+
+	const char * policy;
+	char * end;
+	long forward, left;
+
+	if( string_count == 0 ) return;
+	bt_getStr( zr_command );
+	if( zr_command[0] == '\0' || (policy = strchr( ZR_POLICY_COMMANDS, zr_command[0] )) == NULL ) return;
+
+	// Goal is optional (missing distance to the left is 0).
+	if( policy - ZR_POLICY_COMMANDS == MP_FLOOD_FILL ){
+		forward = strtol( zr_command + 1, &end, 10 );
+		if( end != zr_command + 1 ){
+			left = strtol( end, &end, 10 );
+			zr_setGoal( forward, left );
+		}
+	}
+	zr_selectPolicy( (mp_policy_t)(policy - ZR_POLICY_COMMANDS) );
+}
+
+uint16_t zr_explore( uint8_t speed ){
+	
+	uint8_t node_type;
+	char reaction;
+	uint16_t nodes = 0;
+	
+	// Prepare both arrays for incoming data
+	zm_clearArray( &nodeArr );
+	zm_clearArray( &optimizedNodeArr );
+	mp_init();
+	
+	// Get to the end of the maze
+	do{		
+		zm_driveToNode( speed );
+		zr_sendArrayState( la_getSensorState() );
+		
+		node_type =  zm_checkNode( speed );
+		mp_arrive( node_type );
+		zr_sendArrayState( la_getSensorState() );
+		bt_sendChar( node_type );
+		bt_sendChar( '\r' );
+		
+		// Maze is too big for the map (or position error broke it) - Tremaux rule cannot go on.
+		if( mp_lost() ){
+			driveStop();
+			bt_sendStr( zumoMap.conflict ? "Mapa niespojna\r" : "Mapa pelna\r" );
+			return 0;
+		}
+					
+		// Reaction of selected policy, left-hand rule when it cannot help
+		reaction = mp_choose( node_type );
+		if( reaction != 0 ) zm_guidedNodeReaction( node_type, reaction, speed );
+		else reaction = zm_nodeReaction( node_type, speed );
+		mp_leave( reaction );
+		bt_sendChar( reaction );
+		bt_sendChar( '\r' );
+		nodes++;
+		
+		// Reduced route does not fit in buffer - it could not be replayed.
+		if( optimizedNodeArr.overflow ){
+			driveStop();
+			bt_sendStr("Trasa za dluga\r");
+			return 0;
+		}
+		
+	}while( reaction != 'F' );
+	
+	zr_sendFrameRate();
+	return nodes;
+}
+
+void zr_optimize( void ){
+	
+	// Left-hand route was optimized during exploration. Take the shortest-time path from map when it is complete.
+	mp_plan( &optimizedNodeArr, &zr_profile );
+	bt_sendChar( '\r' );
+	bt_sendChar( '\r' );
+	bt_sendStr("Stara trasa\r");
+	zr_sendRoute( &nodeArr );
+	bt_sendStr("\rNowa trasa\r");
+	zr_sendRoute( &optimizedNodeArr );
+	bt_sendChar( '\r' );
+	bt_sendChar( '\r' );
+}
+
+/**
+	@brief	Function compares fingerprints.
+*/
+static uint8_t zr_fingerprintMatches( const zr_fingerprint_t * expected, const zr_fingerprint_t * measured ){
+
+	uint32_t tolerance = (uint32_t)expected->time_ms * ZR_FINGERPRINT_TOLERANCE / 100;
+
+	if( expected->node_type != measured->node_type ) return 0;
+	return measured->time_ms + tolerance >= expected->time_ms && measured->time_ms <= expected->time_ms + tolerance;
+}
+
+/**
+	@brief	Function checks if command of route can be done in node (e.g. 'T' only in dead end, 'L' only with left branch).
+*/
+static uint8_t zr_commandFits( uint8_t node_type, char command ){
+
+	switch( node_type ){
+		case MAZE_END:							return command == 'F';
+		case DEAD_END:							return command == 'T';
+		case LEFT_TURN:
+		case RIGHT_TURN:						return 1;
+		case STRAIGHT_LEFT_CROSS:		return command == 'S' || command == 'L';
+		case STRAIGHT_RIGHT_CROSS:	return command == 'S' || command == 'R';
+		case LEFT_RIGHT_CROSS:			return command == 'L' || command == 'R';
+		case FULL_CROSS:						return command == 'S' || command == 'L' || command == 'R';
+		default:										return 0;
+	}
+}
+
+/**
+	@brief	Function returns expected length of the next segment for ::zm_driveProfiled (0 - unknown).
+*/
+static uint32_t zr_segmentDistance( void ){
+
+	if( zr_profileLost || zr_segment >= zr_profile.length ) return 0;
+	return (uint32_t)(zr_profile.segment[ zr_segment ] & ~MP_PROFILE_NODE) * ZR_EXPLORE_SPEED;
+}
+
+/**
+	@brief	Function moves to the next profile segment after node.
+*/
+static void zr_nextSegment( uint8_t node_type ){
+
+	uint8_t node_end;
+
+	if( zr_segment >= zr_profile.length ) return;
+	node_end = (zr_profile.segment[ zr_segment ] & MP_PROFILE_NODE) != 0;
+
+	// Plain turn is the end of segment inside edge.
+	if( node_type == LEFT_TURN || node_type == RIGHT_TURN ){
+		if( node_end ) zr_profileLost = 1;
+		else if( !zr_profileLost ) zr_segment++;
+		return;
+	}
+
+	// Crossroad ends edge, so the next one starts after segment with node flag.
+	while( zr_segment < zr_profile.length && !(zr_profile.segment[ zr_segment ] & MP_PROFILE_NODE) ) zr_segment++;
+	zr_segment++;
+	zr_profileLost = 0;
+}
+
+/**
+	@brief	Function returns expected type of the next node learned in exploration (0 - unknown, profile is lost).
+*/
+static uint8_t zr_nextType( void ){
+
+	if( zr_profileLost || zr_segment >= zr_profile.length ) return 0;
+	return zr_profile.node_type[ zr_segment ];
+}
+
+uint16_t zr_replay( uint8_t speed, const zr_fingerprint_t * expected ){
+	
+	uint8_t node_type, next_type;
+	char reaction, next;
+	uint8_t pass;
+	uint16_t nodes = 0;
+	uint32_t time, start = hal_millis();
+	
+	// Read orders and profile from the beginning
+	optimizedNodeArr.cursor = 0;
+	zr_segment = 0;
+	zr_profileLost = 0;
+	
+	// Get to the end without mistakes
+	do{
+		// Node of known type is passed without stopping, unless Zumo turns around or finishes there.
+		next_type = zr_nextType();
+		next = (next_type == LEFT_TURN || next_type == RIGHT_TURN) ? 0 : zm_reactionAt( &optimizedNodeArr, optimizedNodeArr.cursor );
+		pass = next_type != 0 && next != 'T' && next != 'F';
+		zm_driveProfiled( speed, ZR_TOP_SPEED, zr_segmentDistance(), pass );
+		time = hal_millis() - start;
+		zr_sendArrayState( la_getSensorState() );
+		
+		// One frame confirms expected type, full check is done only when it does not match.
+		reaction = pass ? zm_passNode( next_type, next, speed ) : 0;
+		if( reaction != 0 ) node_type = next_type;
+		else{
+			node_type = zm_checkNode( speed );
+			zr_sendArrayState( la_getSensorState() );
+		}
+		bt_sendChar( node_type );
+		bt_sendChar( '\r' );
+		
+		// The first node tells if this is the maze of the route.
+		if( nodes == 0 ){
+			zr_fingerprint.node_type = node_type;
+			zr_fingerprint.time_ms = (time > UINT16_MAX) ? UINT16_MAX : (uint16_t)time;
+			if( expected != NULL && !zr_fingerprintMatches( expected, &zr_fingerprint ) ){
+				driveStop();
+				bt_sendStr("Inny labirynt\r");
+				return 0;
+			}
+		}
+		
+		// Checked node has to fit the next command, otherwise all the next ones would be done in wrong nodes.
+		if( reaction == 0 && !zr_commandFits( node_type, zm_reactionAt( &optimizedNodeArr, optimizedNodeArr.cursor ) ) ){
+			driveStop();
+			bt_sendStr("Wezel nie pasuje do trasy\r");
+			return 0;
+		}
+		
+		// Passed crossroad used its command.
+		if( reaction == 0 ) reaction = zm_strictNodeReaction( &optimizedNodeArr, node_type, speed );
+		else if( next != 0 ) zm_getReaction( &optimizedNodeArr );
+		zr_nextSegment( node_type );
+		bt_sendChar( reaction );
+		bt_sendChar( '\r' );
+		nodes++;
+		
+	}while( reaction != 'F' );
+	
+	driveStop();
+	zr_sendFrameRate();
+	return nodes;
+}
+
+uint8_t zr_saveRecord( void ){
+
+	if( optimizedNodeArr.overflow ) return 0;
+
+	la_getCal( &zumoRecord.calibration );
+	zumoRecord.fingerprint = zr_fingerprint;
+	zumoRecord.route = optimizedNodeArr;
+	zumoRecord.profile = zr_profile;
+	return zs_save( &zumoRecord, sizeof( zumoRecord ) );
+}
+
+uint8_t zr_loadRecord( void ){
+
+	if( !zs_load( &zumoRecord, sizeof( zumoRecord ) ) || zumoRecord.route.overflow ) return 0;
+	la_setCal( &zumoRecord.calibration );
+	optimizedNodeArr = zumoRecord.route;
+	zr_profile = zumoRecord.profile;
+	return 1;
+}
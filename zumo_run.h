@@ -0,0 +1,153 @@
+/**
+	@file	zumo_run.h
+	@brief	Three phases of maze solving run (exploration, optimization, replay) with Bluetooth telemetry.
+	@details	Shared by KL46Z main function and host simulator, so both execute exactly the same sequence.
+*/
+#ifndef ZUMO_RUN_H_
+#define ZUMO_RUN_H_
+#include <stddef.h>
+#include <stdint.h>
+#include "zumo_maze.h"
+#include "zumo_map.h"
+#include "zumo_ledArray.h"
+
+/**
+	@brief	Rotation speed during sensor calibration (0-100).
+*/
+#define ZR_CALIBRATION_SPEED 30
+
+/**
+	@brief	Zumo speed during route exploration (0-100).
+*/
+#define ZR_EXPLORE_SPEED 45
+
+/**
+	@brief	Zumo speed during driving by orders (0-100).
+*/
+#define ZR_REPLAY_SPEED 35
+
+/**
+	@brief	Top speed of replay on straight segments with known length (0-100). Zumo brakes to ::ZR_REPLAY_SPEED before each node.
+*/
+#define ZR_TOP_SPEED 80
+
+/**
+	@brief	Drive time along one grid cell at ::ZR_EXPLORE_SPEED [ms]. It converts goal given in cells (see ::zr_setGoal).
+	@details	Measured in simulator on 150 mm grid. Check it on the real board.
+*/
+#define ZR_CELL_MS 665
+
+/**
+	@brief	Bluetooth commands which select exploration policy, in order of ::mp_policy_t.
+	@details	::MP_FLOOD_FILL command can be followed by goal position in cells, e.g. "F 5 -3" (5 cells ahead, 3 cells to the right).
+*/
+#define ZR_POLICY_COMMANDS "LRTF"
+
+/**
+	@brief	Largest difference between saved and measured drive time to the first node, in percent of saved one.
+*/
+#define ZR_FINGERPRINT_TOLERANCE 15
+
+/**
+	@brief	Maze fingerprint - what Zumo sees before the first reaction.
+*/
+typedef struct{
+	uint8_t node_type;				/**< Type of the first node (::Node_type) */
+	uint16_t time_ms;					/**< Drive time from start to arrival at the first node at ::ZR_REPLAY_SPEED */
+} zr_fingerprint_t;
+
+/**
+	@brief	Data saved in flash after successful replay (see zumo_store.h).
+*/
+typedef struct{
+	la_cal_t calibration;						/**< Sensor calibration */
+	zr_fingerprint_t fingerprint;		/**< Fingerprint of maze measured in replay */
+	NodeArr_t route;								/**< Replayed route */
+	mp_profile_t profile;						/**< Segments of route for speed profile */
+} zr_record_t;
+
+/**
+	@brief	Record loaded by ::zr_loadRecord or saved by ::zr_saveRecord.
+*/
+extern HAL_STATE zr_record_t zumoRecord;
+
+/**
+	@brief	Function sends via Bluetooth state of LED sensor. '1' means black.
+	@param	state Binary coded sensor state.
+*/
+void zr_sendArrayState( char state );
+
+/**
+	@brief	Function sends via Bluetooth command set.
+	@param	route Pointer to node buffer.
+*/
+void zr_sendRoute( const NodeArr_t * route );
+
+/**
+	@brief	Function sends via Bluetooth unsigned number in decimal.
+	@param	value Number.
+*/
+void zr_sendNumber( uint32_t value );
+
+/**
+	@brief	Function selects exploration policy and reports it via Bluetooth.
+	@param	policy Policy enumerated in ::mp_policy_t.
+*/
+void zr_selectPolicy( mp_policy_t policy );
+
+/**
+	@brief	Function sets goal of ::MP_FLOOD_FILL policy.
+	@param	forward Grid cells from start to finish in start direction.
+	@param	left Grid cells from start to finish to the left of start direction (negative - to the right).
+*/
+void zr_setGoal( int16_t forward, int16_t left );
+
+/**
+	@brief	Function executes Bluetooth command if whole one was received (see ::ZR_POLICY_COMMANDS). Call it while waiting for button.
+*/
+void zr_readCommand( void );
+
+/**
+	@brief	Phase 1: Zumo looks for exit using selected exploration policy (::mp_choose) and saves each reaction in ::nodeArr.
+	@details	Sensor frame rate at the finish (::la_historyRate) is sent at the end.
+	@param	speed Zumo velocity in range 0-100.
+	@return	Return value is number of visited nodes, 0 when Zumo stopped, because the maze does not fit in the map (::mp_lost)
+					or reduced route does not fit in ::optimizedNodeArr (::NodeArr_t overflow).
+*/
+uint16_t zr_explore( uint8_t speed );
+
+/**
+	@brief	Phase 2: Function puts the shortest-time path from maze map (::mp_plan) to ::optimizedNodeArr and sends both routes.
+	@details	When the map is not complete, ::optimizedNodeArr keeps left-hand route reduced during exploration and it has no speed profile.
+*/
+void zr_optimize( void );
+
+/**
+	@brief	Phase 3: Zumo drives to the end of maze according to ::optimizedNodeArr.
+	@details	Fingerprint of maze is measured on the way (see ::zr_saveRecord).
+						Segments of known length are driven with speed profile up to ::ZR_TOP_SPEED. When Zumo sees a plain turn where
+						profile expects crossroad, it drives at constant speed to the next crossroad, where profile is synchronised again.
+						Each profile segment carries expected type of the node at its end, so the node is only confirmed by one frame
+						and passed without stopping (::zm_passNode), except turn around. Node is classified (::zm_checkNode) when
+						it does not match or profile is lost. Zumo stops when checked node does not fit the next command (e.g. dead end where
+						crossroad command is, other maze with the same first node). Motors stop at 'F', then sensor frame rate (::la_historyRate) is sent.
+	@param	speed Zumo velocity in range 0-100 (start and end of each segment).
+	@param	expected Fingerprint of maze the route was made for. Zumo stops in the first node when it does not match. NULL - no check.
+	@return	Return value is number of visited nodes, 0 when fingerprint or node does not match.
+*/
+uint16_t zr_replay( uint8_t speed, const zr_fingerprint_t * expected );
+
+/**
+	@brief	Function saves calibration, ::optimizedNodeArr and fingerprint of the last replay in flash. Call it after successful replay.
+	@return	Return value is 1 on success, 0 on flash error or truncated route (::NodeArr_t overflow).
+*/
+uint8_t zr_saveRecord( void );
+
+/**
+	@brief	Function loads saved record to ::zumoRecord, restores calibration and puts the route to ::optimizedNodeArr.
+	@details	Call it after ::la_init, then ::zr_replay with ::zumoRecord fingerprint.
+	@return	Return value is 1 when record was loaded, 0 when there is none.
+*/
+uint8_t zr_loadRecord( void );
+
+#endif
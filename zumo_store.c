@@ -0,0 +1,112 @@
+/**
+	@file	zumo_store.c
+	@brief	Versioned, CRC protected records in flash sector (::hal_flashSector) which survive reset.
+*/
+#include "zumo_store.h"
+#include <string.h>
+
+/**
+	@brief	Size of data with padding to 4-byte flash words.
+*/
+#define ZS_PADDED( size ) ( ((uint32_t)(size) + 3u) & ~3u )
+
+
+uint32_t zs_crc32( const void * data, uint16_t size ){
+
+	const uint8_t * bytes = (const uint8_t *)data;
+	uint32_t crc = 0xFFFFFFFFu;
+	uint16_t i;
+	uint8_t bit;
+
+	for( i=0; i<size; i++ ){
+		crc ^= bytes[i];
+		for( bit=0; bit<8; bit++ ) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+	}
+	return ~crc;
+}
+
+/**
+	@brief	Function walks through records in sector.
+	@param	size Size of wanted record data.
+	@param[out]	last Offset of the last valid record with this size and current version (-1 - none).
+	@return	Return value is offset of free space, ::HAL_FLASH_SECTOR_SIZE when sector is full or damaged.
+*/
+static uint16_t zs_scan( uint16_t size, int16_t * last ){
+
+	const uint8_t * sector = hal_flashSector();
+	zs_header_t header;
+	uint16_t offset = 0;
+
+	*last = -1;
+	while( offset + sizeof( header ) <= HAL_FLASH_SECTOR_SIZE ){
+		memcpy( &header, sector + offset, sizeof( header ) );
+		if( header.magic == 0xFFFF ) return offset;
+		if( header.magic != ZS_MAGIC || offset + sizeof( header ) + ZS_PADDED( header.size ) > HAL_FLASH_SECTOR_SIZE ) break;
+
+		if( header.version == ZS_VERSION && header.size == size
+			&& header.crc == zs_crc32( sector + offset + sizeof( header ), header.size ) ) *last = (int16_t)offset;
+		offset += sizeof( header ) + ZS_PADDED( header.size );
+	}
+	return HAL_FLASH_SECTOR_SIZE;
+}
+
+/**
+	@brief	Function checks if part of sector is erased.
+*/
+static uint8_t zs_erased( uint16_t offset, uint32_t size ){
+
+	const uint8_t * sector = hal_flashSector();
+	uint32_t i;
+
+	for( i=0; i<size; i++ ){
+		if( sector[ offset + i ] != 0xFF ) return 0;
+	}
+	return 1;
+}
+
+uint8_t zs_load( void * data, uint16_t size ){
+
+	int16_t last;
+
+	zs_scan( size, &last );
+	if( last < 0 ) return 0;
+	memcpy( data, hal_flashSector() + last + sizeof( zs_header_t ), size );
+	return 1;
+}
+
+uint8_t zs_save( const void * data, uint16_t size ){
+
+	zs_header_t header;
+	uint32_t length = sizeof( header ) + ZS_PADDED( size );
+	uint16_t whole = size & ~3u;
+	uint8_t tail[4];
+	uint16_t offset;
+	int16_t last;
+
+	if( length > HAL_FLASH_SECTOR_SIZE ) return 0;
+
+	// Start again from empty sector, when record does not fit.
+	offset = zs_scan( size, &last );
+	if( offset + length > HAL_FLASH_SECTOR_SIZE || !zs_erased( offset, length ) ){
+		if( hal_flashErase() ) return 0;
+		offset = 0;
+	}
+
+	// Header goes first, so interrupted writing leaves record with bad CRC.
+	header.magic = ZS_MAGIC;
+	header.version = ZS_VERSION;
+	header.reserved = 0xFF;
+	header.size = size;
+	header.reserved2 = 0xFFFF;
+	header.crc = zs_crc32( data, size );
+	if( hal_flashWrite( offset, &header, sizeof( header ) ) ) return 0;
+	if( whole != 0 && hal_flashWrite( offset + sizeof( header ), data, whole ) ) return 0;
+	if( whole != size ){
+		memset( tail, 0xFF, sizeof( tail ) );
+		memcpy( tail, (const uint8_t *)data + whole, size - whole );
+		if( hal_flashWrite( offset + sizeof( header ) + whole, tail, sizeof( tail ) ) ) return 0;
+	}
+
+	// Verify
+	return memcmp( hal_flashSector() + offset + sizeof( header ), data, size ) == 0;
+}
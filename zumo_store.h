@@ -0,0 +1,61 @@
+/**
+	@file	zumo_store.h
+	@brief	Versioned, CRC protected records in flash sector (::hal_flashSector) which survive reset.
+	@details	Records are appended one after another, so the sector is erased only when the next record does not fit.
+						Each record has header (magic, version, size, CRC-32 of data). The last valid record with current
+						::ZS_VERSION is the saved one. Record broken by reset during writing has bad CRC and it is skipped.
+*/
+#ifndef ZUMO_STORE_H_
+#define ZUMO_STORE_H_
+#include <stdint.h>
+#include "zumo_hal.h"
+#include "zumo_ledArray.h"
+
+/**
+	@brief	Marker of record header.
+*/
+#define ZS_MAGIC 0x5A53
+
+/**
+	@brief	Version of record data layout. Change it when saved structure changes, so old records are ignored.
+	@details	The highest bit is timer of calibration (::LA_TIMER_TPM), its raw values are not valid with the other one.
+*/
+#define ZS_VERSION (4 | (LA_TIMER_TPM << 7))
+
+/**
+	@brief	Header of record in flash.
+*/
+typedef struct{
+	uint16_t magic;						/**< ::ZS_MAGIC (0xFFFF - free space) */
+	uint8_t version;					/**< ::ZS_VERSION of data */
+	uint8_t reserved;					/**< 0xFF */
+	uint16_t size;						/**< Size of data [bytes], data is padded to 4 bytes */
+	uint16_t reserved2;				/**< 0xFFFF */
+	uint32_t crc;							/**< CRC-32 of data */
+} zs_header_t;
+
+/**
+	@brief	Function finds the last valid record.
+	@param[out]	data Destination of record data.
+	@param	size Expected size of data.
+	@return	Return value is 1 when record was copied, 0 when there is no record of this size and version.
+*/
+uint8_t zs_load( void * data, uint16_t size );
+
+/**
+	@brief	Function appends record (sector is erased first when it is full).
+	@param	data Record data.
+	@param	size Size of data, at most ::HAL_FLASH_SECTOR_SIZE - sizeof(::zs_header_t).
+	@return	Return value is 1 on success, 0 on flash error.
+*/
+uint8_t zs_save( const void * data, uint16_t size );
+
+/**
+	@brief	Function calculates CRC-32 (IEEE 802.3, bitwise - no table in flash).
+	@param	data Pointer to data.
+	@param	size Number of bytes.
+	@return	Return value is CRC of data.
+*/
+uint32_t zs_crc32( const void * data, uint16_t size );
+
+#endif